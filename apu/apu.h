@@ -0,0 +1,598 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+#include "blip_buffer.h"
+#include "../scheduler/scheduler.h"
+#include "../util/fnv1a.h"
+#include "../util/spsc_queue.h"
+
+#define CLOCK_RATE          4194304     // T-cycles per second
+#define APU_FRAME_CYCLES    FRAME_CYCLES    // samples are flushed once a frame
+#define FRAME_SEQ_PERIOD    8192        // T-cycles, 512 Hz
+#define AUDIO_RING_SIZE     16384       // stereo sample frames
+#define SAMPLE_RATE         48000
+
+// Sound registers
+#define NR10    0xFF10
+#define NR11    0xFF11
+#define NR12    0xFF12
+#define NR13    0xFF13
+#define NR14    0xFF14
+#define NR21    0xFF16
+#define NR22    0xFF17
+#define NR23    0xFF18
+#define NR24    0xFF19
+#define NR30    0xFF1A
+#define NR31    0xFF1B
+#define NR32    0xFF1C
+#define NR33    0xFF1D
+#define NR34    0xFF1E
+#define NR41    0xFF20
+#define NR42    0xFF21
+#define NR43    0xFF22
+#define NR44    0xFF23
+#define NR50    0xFF24
+#define NR51    0xFF25
+#define NR52    0xFF26
+#define WAVE_RAM    0xFF30  // to 0xFF3F
+
+#define APU_START   0xFF10
+#define APU_END     0xFF40
+
+#define PULSE_1     0
+#define PULSE_2     1
+#define WAVE        2
+#define NOISE       3
+
+struct StereoSample {
+    int16_t left;
+    int16_t right;
+};
+
+struct Channel {
+    bool enabled = false;
+    bool dac = false;
+
+    int length = 0;
+    bool length_enable = false;
+
+    uint8_t volume = 0;
+    uint8_t envelope_initial = 0;
+    bool envelope_up = false;
+    uint8_t envelope_period = 0;
+    uint8_t envelope_timer = 0;
+
+    uint16_t frequency = 0;
+    uint64_t next_edge = 0;     // T-cycle of the next duty/wave/LFSR step
+    uint8_t position = 0;
+
+    int output = 0;             // last amplitude sent to the mixer
+};
+
+// Four channel DMG APU. Nothing is ticked: the APU is caught up to the
+// current time whenever one of its registers is touched and once a frame,
+// stepping each channel from one waveform edge to the next and feeding only
+// amplitude changes to band-limited buffers.
+class APU {
+public:
+    SPSCQueue<StereoSample> samples{AUDIO_RING_SIZE};
+    std::atomic<uint64_t> overruns{0};
+
+    APU() {
+        left.set_rates(CLOCK_RATE, SAMPLE_RATE);
+        right.set_rates(CLOCK_RATE, SAMPLE_RATE);
+        regs[NR52 - APU_START] = 0x80;
+        power = true;
+    }
+
+    uint8_t read(uint16_t address, uint64_t now) {
+        catch_up(now * 4);
+
+        static const uint8_t read_mask[APU_END - APU_START] = {
+            0x80, 0x3F, 0x00, 0xFF, 0xBF, 0xFF, 0x3F, 0x00,
+            0xFF, 0xBF, 0x7F, 0xFF, 0x9F, 0xFF, 0xBF, 0xFF,
+            0xFF, 0x00, 0x00, 0xBF, 0x00, 0x00, 0x70, 0xFF,
+            0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+        };
+
+        if (address >= WAVE_RAM)
+            return regs[address - APU_START];
+
+        if (address == NR52) {
+            uint8_t status = power ? 0x80 : 0x00;
+            for (int i = 0; i < 4; i++)
+                if (channels[i].enabled)
+                    status |= 1 << i;
+            return status | read_mask[address - APU_START];
+        }
+
+        return regs[address - APU_START] | read_mask[address - APU_START];
+    }
+
+    void write(uint16_t address, uint8_t value, uint64_t now) {
+        catch_up(now * 4);
+
+        if (address >= WAVE_RAM) {
+            regs[address - APU_START] = value;
+            return;
+        }
+
+        if (address == NR52) {
+            set_power(value & 0x80);
+            return;
+        }
+
+        if (!power)
+            return;
+
+        regs[address - APU_START] = value;
+
+        switch (address) {
+            case NR10:
+                sweep_period = (value >> 4) & 0x07;
+                sweep_negate = value & 0x08;
+                sweep_shift = value & 0x07;
+                break;
+            case NR11: write_length(PULSE_1, 64 - (value & 0x3F)); break;
+            case NR21: write_length(PULSE_2, 64 - (value & 0x3F)); break;
+            case NR31: write_length(WAVE, 256 - value);            break;
+            case NR41: write_length(NOISE, 64 - (value & 0x3F));   break;
+            case NR12: write_envelope(PULSE_1, value); break;
+            case NR22: write_envelope(PULSE_2, value); break;
+            case NR42: write_envelope(NOISE, value);   break;
+            case NR30:
+                channels[WAVE].dac = value & 0x80;
+                if (!channels[WAVE].dac)
+                    channels[WAVE].enabled = false;
+                break;
+            case NR13: set_frequency(PULSE_1, value, false); break;
+            case NR23: set_frequency(PULSE_2, value, false); break;
+            case NR33: set_frequency(WAVE, value, false);    break;
+            case NR14: set_frequency(PULSE_1, value, true); write_control(PULSE_1, value); break;
+            case NR24: set_frequency(PULSE_2, value, true); write_control(PULSE_2, value); break;
+            case NR34: set_frequency(WAVE, value, true);    write_control(WAVE, value);    break;
+            case NR44: write_control(NOISE, value); break;
+        }
+
+        update_outputs(time);
+    }
+
+    // Audio off: no waveforms, no mixing, no samples. Only what a game can
+    // observe through the registers (NR52 channel bits, length expiry, sweep
+    // overflow) is still modelled, lazily, when the registers are accessed.
+    void set_synthesis(bool on, uint64_t now) {
+        catch_up(now * 4);
+        if (on == synthesis)
+            return;
+        synthesis = on;
+
+        if (on) {
+            left.clear();
+            right.clear();
+            left_output = right_output = 0;
+            frame_start = time;
+            for (int i = 0; i < 4; i++)
+                channels[i].next_edge = time + period(i);
+            update_outputs(time);
+        }
+    }
+
+    // What the game can observe and what decides it next. The mixer and
+    // sample buffers are left out: they depend on synthesis being on.
+    uint64_t state_hash(uint64_t hash) const {
+        hash = fnv1a(regs, sizeof(regs), hash);
+        hash = fnv1a_value(power, hash);
+        for (const Channel &c : channels) {
+            hash = fnv1a_value(c.enabled, hash);
+            hash = fnv1a_value(c.dac, hash);
+            hash = fnv1a_value(c.length, hash);
+            hash = fnv1a_value(c.length_enable, hash);
+            hash = fnv1a_value(c.volume, hash);
+            hash = fnv1a_value(c.envelope_timer, hash);
+            hash = fnv1a_value(c.frequency, hash);
+            hash = fnv1a_value(c.position, hash);
+        }
+        hash = fnv1a_value(sweep_timer, hash);
+        hash = fnv1a_value(sweep_enabled, hash);
+        hash = fnv1a_value(shadow_frequency, hash);
+        hash = fnv1a_value(lfsr, hash);
+        hash = fnv1a_value(frame_seq_next, hash);
+        return fnv1a_value(frame_seq_step, hash);
+    }
+
+    bool synthesis_enabled() const {
+        return synthesis;
+    }
+
+    // Scheduled once a frame: synthesises up to now and hands the finished
+    // samples to the audio thread.
+    void end_frame(uint64_t now) {
+        catch_up(now * 4);
+        if (!synthesis)
+            return;
+
+        uint32_t frame_length = time - frame_start;
+        left.end_frame(frame_length);
+        right.end_frame(frame_length);
+        frame_start = time;
+
+        StereoSample chunk[BLIP_BUFFER_SIZE];
+        int count = left.samples_available();
+        left.read_samples(&chunk[0].left, count, 2, gain);
+        right.read_samples(&chunk[0].right, count, 2, gain);
+
+        size_t queued = samples.push(chunk, count);
+        if (queued < static_cast<size_t>(count))
+            overruns += count - queued;
+    }
+
+private:
+    uint8_t regs[APU_END - APU_START] = {};
+    bool power = false;
+    Channel channels[4];
+
+    uint8_t sweep_period = 0;
+    bool sweep_negate = false;
+    uint8_t sweep_shift = 0;
+    uint8_t sweep_timer = 0;
+    bool sweep_enabled = false;
+    uint16_t shadow_frequency = 0;
+
+    uint16_t lfsr = 0x7FFF;
+
+    bool synthesis = true;
+    uint64_t time = 0;              // T-cycles synthesised so far
+    uint64_t frame_start = 0;
+    uint64_t frame_seq_next = FRAME_SEQ_PERIOD;
+    uint8_t frame_seq_step = 0;
+
+    BlipBuffer left;
+    BlipBuffer right;
+    int left_output = 0;
+    int right_output = 0;
+    float gain = 32767.0f / 512;    // 4 channels * +-15 * master volume 8
+
+    // ---------
+    // TIMELINE
+    // ---------
+
+    void catch_up(uint64_t target) {
+        if (!synthesis) {
+            catch_up_silent(target);
+            return;
+        }
+
+        while (time < target) {
+            uint64_t until = frame_seq_next < target ? frame_seq_next : target;
+
+            for (int i = 0; i < 4; i++)
+                run_channel(i, until);
+            time = until;
+
+            if (time == frame_seq_next) {
+                clock_frame_sequencer();
+                frame_seq_next += FRAME_SEQ_PERIOD;
+                update_outputs(time);
+            }
+        }
+    }
+
+    // Only the frame sequencer matters without sound. When no running channel
+    // has a length counter or sweep that could switch it off, the remaining
+    // steps are skipped in one go.
+    void catch_up_silent(uint64_t target) {
+        while (frame_seq_next <= target) {
+            if (!observable()) {
+                uint64_t steps = (target - frame_seq_next) / FRAME_SEQ_PERIOD + 1;
+                frame_seq_step = (frame_seq_step + steps) & 0x07;
+                frame_seq_next += steps * FRAME_SEQ_PERIOD;
+                break;
+            }
+            clock_frame_sequencer();
+            frame_seq_next += FRAME_SEQ_PERIOD;
+        }
+        if (target > time)
+            time = target;
+    }
+
+    bool observable() {
+        for (int i = 0; i < 4; i++)
+            if (channels[i].enabled && channels[i].length_enable)
+                return true;
+        return channels[PULSE_1].enabled && sweep_enabled && sweep_period;
+    }
+
+    uint32_t period(int i) {
+        Channel &c = channels[i];
+        switch (i) {
+            case PULSE_1:
+            case PULSE_2:
+                return (2048 - c.frequency) * 4;
+            case WAVE:
+                return (2048 - c.frequency) * 2;
+            default: {
+                uint8_t nr43 = regs[NR43 - APU_START];
+                uint32_t divisor = (nr43 & 0x07) ? (nr43 & 0x07) * 16 : 8;
+                return divisor << (nr43 >> 4);
+            }
+        }
+    }
+
+    // Steps the channel through every edge before until, emitting an
+    // amplitude change at each one.
+    void run_channel(int i, uint64_t until) {
+        Channel &c = channels[i];
+        if (!c.enabled)
+            return;
+
+        uint32_t step = period(i);
+        while (c.next_edge < until) {
+            switch (i) {
+                case PULSE_1:
+                case PULSE_2:
+                    c.position = (c.position + 1) & 0x07;
+                    break;
+                case WAVE:
+                    c.position = (c.position + 1) & 0x1F;
+                    break;
+                case NOISE: {
+                    uint16_t bit = (lfsr ^ (lfsr >> 1)) & 0x01;
+                    lfsr = (lfsr >> 1) | (bit << 14);
+                    if (regs[NR43 - APU_START] & 0x08)
+                        lfsr = (lfsr & ~0x40) | (bit << 6);
+                    break;
+                }
+            }
+            update_output(i, c.next_edge);
+            c.next_edge += step;
+        }
+    }
+
+    void clock_frame_sequencer() {
+        if (!(frame_seq_step & 0x01))
+            for (int i = 0; i < 4; i++)
+                clock_length(i);
+        if (frame_seq_step == 2 || frame_seq_step == 6)
+            clock_sweep();
+        if (frame_seq_step == 7) {
+            clock_envelope(PULSE_1);
+            clock_envelope(PULSE_2);
+            clock_envelope(NOISE);
+        }
+        frame_seq_step = (frame_seq_step + 1) & 0x07;
+    }
+
+    void clock_length(int i) {
+        Channel &c = channels[i];
+        if (c.length_enable && c.length > 0 && --c.length == 0)
+            c.enabled = false;
+    }
+
+    void clock_envelope(int i) {
+        Channel &c = channels[i];
+        if (!c.envelope_period)
+            return;
+        if (c.envelope_timer && --c.envelope_timer)
+            return;
+
+        c.envelope_timer = c.envelope_period;
+        if (c.envelope_up && c.volume < 15)
+            c.volume++;
+        else if (!c.envelope_up && c.volume > 0)
+            c.volume--;
+    }
+
+    uint16_t sweep_calculate() {
+        uint16_t delta = shadow_frequency >> sweep_shift;
+        uint16_t frequency = sweep_negate ? shadow_frequency - delta : shadow_frequency + delta;
+        if (frequency > 2047)
+            channels[PULSE_1].enabled = false;
+        return frequency;
+    }
+
+    void clock_sweep() {
+        if (sweep_timer && --sweep_timer)
+            return;
+        sweep_timer = sweep_period ? sweep_period : 8;
+
+        if (!sweep_enabled || !sweep_period)
+            return;
+
+        uint16_t frequency = sweep_calculate();
+        if (frequency <= 2047 && sweep_shift) {
+            shadow_frequency = frequency;
+            channels[PULSE_1].frequency = frequency;
+            sweep_calculate();
+        }
+    }
+
+    // ---------
+    // REGISTERS
+    // ---------
+
+    void write_length(int i, int length) {
+        channels[i].length = length;
+    }
+
+    void write_envelope(int i, uint8_t value) {
+        Channel &c = channels[i];
+        c.envelope_initial = value >> 4;
+        c.envelope_up = value & 0x08;
+        c.envelope_period = value & 0x07;
+        c.dac = value & 0xF8;
+        if (!c.dac)
+            c.enabled = false;
+    }
+
+    void set_frequency(int i, uint8_t value, bool high) {
+        Channel &c = channels[i];
+        if (high)
+            c.frequency = (c.frequency & 0x00FF) | ((value & 0x07) << 8);
+        else
+            c.frequency = (c.frequency & 0x0700) | value;
+    }
+
+    void write_control(int i, uint8_t value) {
+        Channel &c = channels[i];
+        c.length_enable = value & 0x40;
+        if (value & 0x80)
+            trigger(i);
+    }
+
+    void trigger(int i) {
+        Channel &c = channels[i];
+        c.enabled = c.dac;
+        if (c.length == 0)
+            c.length = i == WAVE ? 256 : 64;
+        c.volume = c.envelope_initial;
+        c.envelope_timer = c.envelope_period;
+        c.position = 0;
+        c.next_edge = time + period(i);
+
+        if (i == NOISE)
+            lfsr = 0x7FFF;
+
+        if (i == PULSE_1) {
+            shadow_frequency = c.frequency;
+            sweep_timer = sweep_period ? sweep_period : 8;
+            sweep_enabled = sweep_period || sweep_shift;
+            if (sweep_shift)
+                sweep_calculate();
+        }
+    }
+
+    void set_power(bool on) {
+        if (on == power)
+            return;
+        power = on;
+        regs[NR52 - APU_START] = on ? 0x80 : 0x00;
+
+        if (!on) {
+            for (uint16_t address = APU_START; address < NR52; address++)
+                regs[address - APU_START] = 0;
+            for (int i = 0; i < 4; i++)
+                channels[i] = Channel();
+            sweep_period = sweep_shift = 0;
+            sweep_negate = sweep_enabled = false;
+        } else {
+            frame_seq_step = 0;
+        }
+        update_outputs(time);
+    }
+
+    // -----
+    // MIXER
+    // -----
+
+    int amplitude(int i) {
+        Channel &c = channels[i];
+        if (!c.enabled || !c.dac)
+            return 0;
+
+        int level;
+        switch (i) {
+            case PULSE_1:
+            case PULSE_2: {
+                static const uint8_t duty[4] = {0x01, 0x81, 0x87, 0x7E};
+                uint8_t pattern = duty[regs[(i == PULSE_1 ? NR11 : NR21) - APU_START] >> 6];
+                level = (pattern >> c.position) & 0x01 ? c.volume : 0;
+                break;
+            }
+            case WAVE: {
+                uint8_t byte = regs[WAVE_RAM - APU_START + c.position / 2];
+                uint8_t sample = (c.position & 0x01) ? byte & 0x0F : byte >> 4;
+                uint8_t shift = (regs[NR32 - APU_START] >> 5) & 0x03;
+                level = shift ? sample >> (shift - 1) : 0;
+                break;
+            }
+            default:
+                level = (lfsr & 0x01) ? 0 : c.volume;
+                break;
+        }
+        return level * 2 - 15;
+    }
+
+    void update_output(int i, uint64_t at) {
+        if (!synthesis)
+            return;
+        channels[i].output = amplitude(i);
+        mix(at);
+    }
+
+    void update_outputs(uint64_t at) {
+        if (!synthesis)
+            return;
+        for (int i = 0; i < 4; i++)
+            channels[i].output = amplitude(i);
+        mix(at);
+    }
+
+    void mix(uint64_t at) {
+        uint8_t nr50 = regs[NR50 - APU_START];
+        uint8_t nr51 = regs[NR51 - APU_START];
+        int l = 0, r = 0;
+
+        for (int i = 0; i < 4; i++) {
+            if (nr51 & (0x10 << i)) l += channels[i].output;
+            if (nr51 & (0x01 << i)) r += channels[i].output;
+        }
+        l *= ((nr50 >> 4) & 0x07) + 1;
+        r *= (nr50 & 0x07) + 1;
+
+        uint32_t offset = at - frame_start;
+        if (l != left_output) {
+            left.add_delta(offset, l - left_output);
+            left_output = l;
+        }
+        if (r != right_output) {
+            right.add_delta(offset, r - right_output);
+            right_output = r;
+        }
+    }
+};
+
+// Drains the APU ring on its own thread and hands samples to sink (audio
+// device, recorder, ...). The emulation thread never waits on it.
+class AudioThread {
+public:
+    AudioThread(SPSCQueue<StereoSample> &_samples, std::function<void(const StereoSample *, size_t)> _sink)
+        : samples(_samples), sink(_sink) {}
+
+    ~AudioThread() {
+        stop();
+    }
+
+    void start() {
+        running = true;
+        worker = std::thread(&AudioThread::loop, this);
+    }
+
+    void stop() {
+        if (!running)
+            return;
+        running = false;
+        worker.join();
+    }
+
+private:
+    SPSCQueue<StereoSample> &samples;
+    std::function<void(const StereoSample *, size_t)> sink;
+    std::thread worker;
+    std::atomic<bool> running{false};
+
+    void loop() {
+        StereoSample chunk[1024];
+        while (running) {
+            size_t count = samples.pop(chunk, 1024);
+            if (count)
+                sink(chunk, count);
+            else
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#define BLIP_PHASE_BITS     5
+#define BLIP_PHASES         (1 << BLIP_PHASE_BITS)
+#define BLIP_TAPS           16
+#define BLIP_BUFFER_SIZE    8192
+
+// Band-limited step synthesis. Amplitude changes are recorded as deltas at
+// their exact clock time, spread over a few samples by a windowed sinc
+// impulse, and integrated back into a waveform when samples are read. Cost is
+// per amplitude change, not per clock.
+class BlipBuffer {
+public:
+    BlipBuffer() {
+        for (int phase = 0; phase < BLIP_PHASES; phase++) {
+            double sum = 0;
+            for (int k = 0; k < BLIP_TAPS; k++) {
+                double x = k - BLIP_TAPS / 2 + 1 - static_cast<double>(phase) / BLIP_PHASES;
+                double sinc = x == 0 ? 1.0 : sin(M_PI * x) / (M_PI * x);
+                double window = 0.42 + 0.5 * cos(M_PI * x / (BLIP_TAPS / 2))
+                                     + 0.08 * cos(2 * M_PI * x / (BLIP_TAPS / 2));
+                kernel[phase][k] = sinc * window;
+                sum += kernel[phase][k];
+            }
+            for (int k = 0; k < BLIP_TAPS; k++)
+                kernel[phase][k] /= sum;
+        }
+        clear();
+    }
+
+    void set_rates(double clock_rate, double sample_rate) {
+        factor = static_cast<uint64_t>(sample_rate / clock_rate * 4294967296.0);
+    }
+
+    void clear() {
+        memset(buffer, 0, sizeof(buffer));
+        offset = 0;
+        available = 0;
+        integrator = 0;
+        dc = 0;
+    }
+
+    // clock_time is relative to the start of the current frame.
+    void add_delta(uint32_t clock_time, float delta) {
+        uint64_t position = offset + clock_time * factor;
+        uint32_t index = (position >> 32) + available;
+        if (index >= BLIP_BUFFER_SIZE)
+            return;
+
+        const float *k = kernel[(position >> (32 - BLIP_PHASE_BITS)) & (BLIP_PHASES - 1)];
+        float *out = &buffer[index];
+        for (int i = 0; i < BLIP_TAPS; i++)
+            out[i] += delta * k[i];
+    }
+
+    // Makes the samples up to clock_time (relative to the frame start)
+    // readable and starts a new frame there.
+    void end_frame(uint32_t clock_time) {
+        uint64_t position = offset + clock_time * factor;
+        available += position >> 32;
+        if (available > BLIP_BUFFER_SIZE)
+            available = BLIP_BUFFER_SIZE;
+        offset = position & 0xFFFFFFFF;
+    }
+
+    int samples_available() const {
+        return available;
+    }
+
+    // Integrates count samples into out (stride apart, for interleaving),
+    // with a gentle high-pass to remove the DC offset.
+    int read_samples(int16_t *out, int count, int stride, float gain) {
+        if (count > available)
+            count = available;
+
+        for (int i = 0; i < count; i++) {
+            integrator += buffer[i];
+            dc += (integrator - dc) * 0.0005f;
+            float sample = (integrator - dc) * gain;
+            if (sample > 32767)  sample = 32767;
+            if (sample < -32768) sample = -32768;
+            out[i * stride] = static_cast<int16_t>(sample);
+        }
+
+        int remaining = available - count + BLIP_TAPS;
+        memmove(buffer, buffer + count, remaining * sizeof(float));
+        memset(buffer + remaining, 0, count * sizeof(float));
+        available -= count;
+        return count;
+    }
+
+private:
+    float kernel[BLIP_PHASES][BLIP_TAPS];
+    float buffer[BLIP_BUFFER_SIZE + BLIP_TAPS];
+    uint64_t factor = 0;    // samples per clock, 32.32 fixed point
+    uint64_t offset;        // fractional sample position of the frame start
+    int available;
+    float integrator;
+    float dc;
+};
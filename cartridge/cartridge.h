@@ -0,0 +1,211 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "../util/byte_sum.h"
+#include "cartridge_maps.h"
+#include "rom_identity.h"
+#include "rom_image.h"
+
+#define TITLE_LENGTH    0xF
+#define NINTENDO_LOGO   0x0104   // to 0x0133
+#define TITLE           0x0134   // to 0x0143
+#define CGB_FLAG        0x0143
+#define SGB_FLAG        0x0146
+#define CART_TYPE       0x0147
+#define ROM_BANKS       0x0148
+#define RAM_SIZE        0x0149
+#define DESTINATION     0X014A
+#define OLD_LICENSEE    0x014B
+#define NEW_LICENSEE    0x0144   // to 0x145
+#define ROM_VERSION     0x014C
+#define HEADER_CHECKSUM 0x014D
+#define GLOBAL_CHECKSUM 0x014E   // to 0x014F, big endian
+
+#define LOGO_LENGTH     0x30
+
+static const uint8_t nintendo_logo[LOGO_LENGTH] = {
+    0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B, 0x03, 0x73, 0x00, 0x83,
+    0x00, 0x0C, 0x00, 0x0D, 0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E,
+    0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99, 0xBB, 0xBB, 0x67, 0x63,
+    0x6E, 0x0E, 0xEC, 0xCC, 0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E
+};
+
+// Result of Cartridge::verify(). Each check keeps the value stored in the
+// header next to the computed one so a mismatch can be reported.
+struct HeaderValidation {
+    bool logo_ok;
+    bool header_ok;
+    uint8_t header_stored;
+    uint8_t header_computed;
+    bool global_ok;
+    uint16_t global_stored;
+    uint16_t global_computed;
+    bool size_ok;           // file holds every bank the header promises
+    uint32_t size_expected;
+
+    // Real hardware only checks the logo and the header checksum, many
+    // released games ship with a wrong global checksum.
+    bool bootable() const {
+        return logo_ok && header_ok;
+    }
+
+    bool valid() const {
+        return logo_ok && header_ok && global_ok && size_ok;
+    }
+};
+
+inline std::string_view licensee_name(uint8_t old_code, char new_code_hi, char new_code_lo) {
+    if (old_code == 0x33) {
+        int code = new_licensee_index(new_code_hi, new_code_lo);
+        return code < 0 ? UNKNOWN_NAME : new_licensee_codes[code];
+    }
+    return old_licensee_codes[old_code];
+}
+
+inline std::string_view cartridge_type_name(uint8_t type) {
+    return cartridge_type_map[type];
+}
+
+class Cartridge {
+public:
+    const char *filename;
+    ROMImage image;
+    const uint8_t *ROM = nullptr;
+    int ROM_size;
+    std::string title;
+    std::string_view developer;
+    std::string_view cartridge_type;
+    std::string destination;
+    uint8_t CGB_flag;
+    uint8_t SGB_flag;
+    uint16_t ROM_banks;
+    int16_t RAM_size;       // KiB
+    ROMIdentity identity;   // not computed for header-only buffers
+
+    Cartridge(const char *_filename){
+        filename = _filename;
+        if (load_cartridge()) {
+            parse_header();
+            identity = identify_rom(ROM, ROM_size);
+        }
+    }
+
+    // Parses an image that is already mapped (e.g. the one the memory map
+    // uses), without opening the file again.
+    Cartridge(const ROMImage &shared, const char *_filename) {
+        filename = _filename;
+        ROM = shared.data;
+        ROM_size = shared.size;
+        parse_header();
+        identity = identify_rom(ROM, ROM_size);
+    }
+
+    // Parses bytes already in memory. Only the header (up to 0x014F) has to
+    // be valid, so a 0x150 byte buffer is enough.
+    Cartridge(const uint8_t *_ROM, int _ROM_size, const char *_filename) {
+        filename = _filename;
+        ROM = _ROM;
+        ROM_size = _ROM_size;
+        parse_header();
+    }
+
+    void parse_header() {
+        for (int i = 0; i < TITLE_LENGTH; i++)
+            title += ROM[TITLE + i];
+
+        developer = licensee_name(ROM[OLD_LICENSEE], ROM[NEW_LICENSEE], ROM[NEW_LICENSEE + 1]);
+
+        SGB_flag = ROM[SGB_FLAG];
+        CGB_flag = ROM[CGB_FLAG];
+        ROM_banks = ROM_banks_map[ROM[ROM_BANKS]];
+        RAM_size = RAM_size_map[ROM[RAM_SIZE]];
+        cartridge_type = cartridge_type_name(ROM[CART_TYPE]);
+    }
+
+    bool load_cartridge() {
+        if (!image.open(filename))
+            return false;
+
+        std::cout << "Opened: " << filename << "\n";
+
+        ROM = image.data;
+        ROM_size = image.size;
+        return true;
+    }
+
+    bool logo_valid() {
+        return memcmp(ROM + NINTENDO_LOGO, nintendo_logo, LOGO_LENGTH) == 0;
+    }
+
+    // The boot ROM refuses to start a cartridge when this doesn't match.
+    uint8_t header_checksum() {
+        uint8_t checksum = 0;
+        for (uint16_t address = TITLE; address <= ROM_VERSION; address++)
+            checksum = checksum - ROM[address] - 1;
+        return checksum;
+    }
+
+    bool header_checksum_valid() {
+        return header_checksum() == ROM[HEADER_CHECKSUM];
+    }
+
+    // Sum of every byte except the checksum itself, big endian at 0x014E.
+    uint16_t global_checksum() {
+        uint64_t sum = byte_sum(ROM, ROM_size) - ROM[GLOBAL_CHECKSUM] - ROM[GLOBAL_CHECKSUM + 1];
+        return static_cast<uint16_t>(sum);
+    }
+
+    uint16_t stored_global_checksum() {
+        return (ROM[GLOBAL_CHECKSUM] << 8) | ROM[GLOBAL_CHECKSUM + 1];
+    }
+
+    // Needs the whole ROM, not just the header.
+    HeaderValidation verify() {
+        HeaderValidation result;
+        result.logo_ok = logo_valid();
+        result.header_stored = ROM[HEADER_CHECKSUM];
+        result.header_computed = header_checksum();
+        result.header_ok = result.header_stored == result.header_computed;
+        result.global_stored = stored_global_checksum();
+        result.global_computed = global_checksum();
+        result.global_ok = result.global_stored == result.global_computed;
+        result.size_expected = ROM_banks * 0x4000u;
+        result.size_ok = ROM_banks != 0 && (uint32_t)ROM_size >= result.size_expected;
+        return result;
+    }
+
+    void print_validation(const HeaderValidation &result) {
+        std::cout << "Logo: " << (result.logo_ok ? "ok" : "mismatch") << "\n";
+        std::cout << std::hex;
+        std::cout << "Header checksum: 0x" << (int)result.header_stored;
+        if (!result.header_ok)
+            std::cout << " (computed 0x" << (int)result.header_computed << ")";
+        std::cout << "\nGlobal checksum: 0x" << result.global_stored;
+        if (!result.global_ok)
+            std::cout << " (computed 0x" << result.global_computed << ")";
+        std::cout << std::dec << "\n";
+        if (!result.size_ok)
+            std::cout << "ROM size " << ROM_size << " smaller than the " << result.size_expected << " bytes in the header\n";
+    }
+
+    uint8_t get_byte (uint16_t i) {
+        return ROM[i];
+    }
+
+    void print_info() {
+        std::cout << "Title: " << title << "\n";
+        std::cout << "Developer: " << developer << "\n";
+        std::cout << "ROM Size: " << ROM_size << "\n";
+        std::cout << "Cartridge Type: " << cartridge_type << "\n";
+        std::cout << "CRC32: " << std::hex << identity.crc32 << " XXH64: " << identity.xxh64 << std::dec << "\n";
+    }
+
+    void close_cartridge() {
+        image.close();
+        ROM = nullptr;
+    }
+};
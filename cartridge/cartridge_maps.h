@@ -1,76 +1,109 @@
-#include <unordered_map>
-#include <string>
+#pragma once
+
+#include <array>
 #include <cstdint>
+#include <string_view>
+#include <utility>
+
+#define UNKNOWN_NAME    "Unknown"
+
+// Header byte -> name. Built at compile time, so there are no static
+// constructors and a lookup is a single indexed load.
+struct CodeName {
+    uint8_t code;
+    std::string_view name;
+};
+
+template <size_t N>
+constexpr std::array<std::string_view, 256> name_table(const CodeName (&names)[N]) {
+    std::array<std::string_view, 256> table{};
+    for (size_t i = 0; i < table.size(); i++)
+        table[i] = UNKNOWN_NAME;
+    for (size_t i = 0; i < N; i++)
+        table[names[i].code] = names[i].name;
+    return table;
+}
+
+template <typename T, size_t N>
+constexpr std::array<T, 256> value_table(const std::pair<uint8_t, T> (&values)[N]) {
+    std::array<T, 256> table{};
+    for (size_t i = 0; i < N; i++)
+        table[values[i].first] = values[i].second;
+    return table;
+}
 
-std::unordered_map<std::string, std::string> new_licensee_codes = {
-    {"00", "None"},
-    {"01", "Nintendo Research & Development 1"},
-    {"08", "Capcom"},
-    {"13", "EA (Electronic Arts)"},
-    {"18", "Hudson Soft"},
-    {"19", "b-Att"},
-    {"20", "KSS"},
-    {"22", "Planning Office WADA"},
-    {"24", "PCM Complete"},
-    {"25", "San-X"},
-    {"28", "Kemco"},
-    {"29", "SETA Corporation"},
-    {"30", "Viacom"},
-    {"31", "Nintendo"},
-    {"32", "Bandai"},
-    {"33", "Ocean Software/Acclaim Entertainment"},
-    {"34", "Konami"},
-    {"35", "HectorSoft"},
-    {"37", "Taito"},
-    {"38", "Hudson Soft"},
-    {"39", "Banpresto"},
-    {"41", "Ubi Soft"},
-    {"42", "Atlus"},
-    {"44", "Malibu Interactive"},
-    {"46", "Angel"},
-    {"47", "Bullet-Proof Software"},
-    {"49", "Irem"},
-    {"50", "Absolute"},
-    {"51", "Acclaim Entertainment"},
-    {"52", "Activision"},
-    {"53", "Sammy USA Corporation"},
-    {"54", "Konami"},
-    {"55", "Hi Tech Expressions"},
-    {"56", "LJN"},
-    {"57", "Matchbox"},
-    {"58", "Mattel"},
-    {"59", "Milton Bradley Company"},
-    {"60", "Titus Interactive"},
-    {"61", "Virgin Games Ltd."},
-    {"64", "Lucasfilm Games"},
-    {"67", "Ocean Software"},
-    {"69", "EA (Electronic Arts)"},
-    {"70", "Infogrames"},
-    {"71", "Interplay Entertainment"},
-    {"72", "Broderbund"},
-    {"73", "Sculptured Software"},
-    {"75", "The Sales Curve Limited"},
-    {"78", "T*HQ"},
-    {"79", "Accolade"},
-    {"80", "Misawa Entertainment"},
-    {"82", "Toze"},
-    {"83", "Tokuma Shoten"},
-    {"84", "Tsukuda Original"},
-    {"86", "Chunsoft Co."},
-    {"87", "Video System"},
-    {"91", "Ocean Software/Acclaim Entertainment"},
-    {"92", "Varie"},
-    {"93", "Yonezawa/s’pal"},
-    {"95", "Kaneko"},
-    {"96", "Pack-In-Video"},
-    {"97", "Bottom Up"},
-    {"98", "Konami (Yu-Gi-Oh!)"},
-    {"99", "MTO"},
-    {"A4", "Kodansha"}
+// New licensee codes are two ASCII characters, all of them hex digits, so
+// they are indexed by the byte the digits spell (see new_licensee_index).
+inline constexpr CodeName new_licensee_list[] = {
+    {0x00, "None"},
+    {0x01, "Nintendo Research & Development 1"},
+    {0x08, "Capcom"},
+    {0x13, "EA (Electronic Arts)"},
+    {0x18, "Hudson Soft"},
+    {0x19, "b-Att"},
+    {0x20, "KSS"},
+    {0x22, "Planning Office WADA"},
+    {0x24, "PCM Complete"},
+    {0x25, "San-X"},
+    {0x28, "Kemco"},
+    {0x29, "SETA Corporation"},
+    {0x30, "Viacom"},
+    {0x31, "Nintendo"},
+    {0x32, "Bandai"},
+    {0x33, "Ocean Software/Acclaim Entertainment"},
+    {0x34, "Konami"},
+    {0x35, "HectorSoft"},
+    {0x37, "Taito"},
+    {0x38, "Hudson Soft"},
+    {0x39, "Banpresto"},
+    {0x41, "Ubi Soft"},
+    {0x42, "Atlus"},
+    {0x44, "Malibu Interactive"},
+    {0x46, "Angel"},
+    {0x47, "Bullet-Proof Software"},
+    {0x49, "Irem"},
+    {0x50, "Absolute"},
+    {0x51, "Acclaim Entertainment"},
+    {0x52, "Activision"},
+    {0x53, "Sammy USA Corporation"},
+    {0x54, "Konami"},
+    {0x55, "Hi Tech Expressions"},
+    {0x56, "LJN"},
+    {0x57, "Matchbox"},
+    {0x58, "Mattel"},
+    {0x59, "Milton Bradley Company"},
+    {0x60, "Titus Interactive"},
+    {0x61, "Virgin Games Ltd."},
+    {0x64, "Lucasfilm Games"},
+    {0x67, "Ocean Software"},
+    {0x69, "EA (Electronic Arts)"},
+    {0x70, "Infogrames"},
+    {0x71, "Interplay Entertainment"},
+    {0x72, "Broderbund"},
+    {0x73, "Sculptured Software"},
+    {0x75, "The Sales Curve Limited"},
+    {0x78, "T*HQ"},
+    {0x79, "Accolade"},
+    {0x80, "Misawa Entertainment"},
+    {0x82, "Toze"},
+    {0x83, "Tokuma Shoten"},
+    {0x84, "Tsukuda Original"},
+    {0x86, "Chunsoft Co."},
+    {0x87, "Video System"},
+    {0x91, "Ocean Software/Acclaim Entertainment"},
+    {0x92, "Varie"},
+    {0x93, "Yonezawa/s’pal"},
+    {0x95, "Kaneko"},
+    {0x96, "Pack-In-Video"},
+    {0x97, "Bottom Up"},
+    {0x98, "Konami (Yu-Gi-Oh!)"},
+    {0x99, "MTO"},
+    {0xA4, "Kodansha"}
 };
+inline constexpr auto new_licensee_codes = name_table(new_licensee_list);
 
 
-std::unordered_map<uint8_t, std::string> old_licensee_codes = {
+inline constexpr CodeName old_licensee_list[] = {
     {0x00, "None"},
     {0x01, "Nintendo"},
     {0x08, "Capcom"},
@@ -219,8 +252,9 @@ std::unordered_map<uint8_t, std::string> old_licensee_codes = {
     {0xF3, "Extreme Entertainment"},
     {0xFF, "LJN"}
 };
+inline constexpr auto old_licensee_codes = name_table(old_licensee_list);
 
-std::unordered_map<uint8_t, std::string> cartridge_type_map = {
+inline constexpr CodeName cartridge_type_list[] = {
     {0x00, "ROM ONLY"},
     {0x01, "MBC1"},
     {0x02, "MBC1+RAM"},
@@ -250,8 +284,10 @@ std::unordered_map<uint8_t, std::string> cartridge_type_map = {
     {0xFE, "HuC3"},
     {0xFF, "HuC1+RAM+BATTERY"}
 };
+inline constexpr auto cartridge_type_map = name_table(cartridge_type_list);
 
-std::unordered_map<uint8_t, char> ROM_banks_map = {
+// 0 for an invalid size byte
+inline constexpr std::pair<uint8_t, uint16_t> ROM_banks_list[] = {
     {0x00, 2},    // 32 KiB
     {0x01, 4},    // 64 KiB
     {0x02, 8},    // 128 KiB
@@ -265,12 +301,26 @@ std::unordered_map<uint8_t, char> ROM_banks_map = {
     {0x53, 80},   // 1.2 MiB
     {0x54, 96}    // 1.5 MiB
 };
+inline constexpr auto ROM_banks_map = value_table(ROM_banks_list);
 
-std::unordered_map<uint8_t, char> RAM_size_map = {
+// KiB, 0 for an invalid size byte
+inline constexpr std::pair<uint8_t, int16_t> RAM_size_list[] = {
     {0x00, 0},      // No RAM
     {0x01, -1},     // Unused
     {0x02, 8},      // 1 bank
     {0x03, 32},     // 4 banks of 8 KiB each
     {0x04, 128},    // 16 banks of 8 KiB each
     {0x05, 64}      // 8 banks of 8 KiB each
-};
\ No newline at end of file
+};
+inline constexpr auto RAM_size_map = value_table(RAM_size_list);
+
+// -1 if either character is not a hex digit.
+inline int new_licensee_index(char hi, char lo) {
+    auto digit = [](char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    };
+    int h = digit(hi), l = digit(lo);
+    return (h < 0 || l < 0) ? -1 : (h << 4) | l;
+}
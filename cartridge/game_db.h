@@ -0,0 +1,150 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../memory/mbc.h"
+#include "rom_identity.h"
+
+// GameSettings quirks
+#define QUIRK_MBC1_MULTICART    0x01    // MBC1M: 4-bit bank register, 256 KiB games
+
+// Per-game settings that can't be read from the header.
+struct GameSettings {
+    ROMIdentity identity;
+    std::string title;
+    std::vector<uint16_t> idle_loops;   // PCs of loops that only wait for an event
+    int mbc = -1;                       // MBCType to use instead of the header's, -1 for none
+    uint32_t quirks = 0;
+};
+
+// Local database of GameSettings keyed by ROM identity. Plain text so it
+// can be edited and merged by hand, one game per line:
+//   <crc32> <xxh64> <size> [title=..] [idle=0x1234,..] [mbc=MBC1] [quirks=mbc1m]
+class GameDB {
+public:
+    bool load(const char *filename) {
+        std::ifstream file(filename);
+        if (!file)
+            return false;
+
+        std::string line;
+        int number = 0;
+        while (std::getline(file, line)) {
+            number++;
+            if (line.empty() || line[0] == '#')
+                continue;
+
+            GameSettings settings;
+            if (!parse(line, settings)) {
+                std::cout << filename << ":" << number << ": bad entry\n";
+                continue;
+            }
+            games[settings.identity.xxh64] = settings;
+        }
+        return true;
+    }
+
+    bool save(const char *filename) {
+        std::string temporary = std::string(filename) + ".tmp";
+        std::ofstream file(temporary);
+        if (!file)
+            return false;
+
+        file << "# crc32 xxh64 size [title=] [idle=] [mbc=] [quirks=]\n";
+        for (auto &entry : games)
+            file << format(entry.second) << "\n";
+        file.close();
+        return file && rename(temporary.c_str(), filename) == 0;
+    }
+
+    // Only an entry whose CRC32 and size match too, so an XXH64 collision
+    // can't apply another game's settings.
+    const GameSettings *find(const ROMIdentity &identity) const {
+        auto it = games.find(identity.xxh64);
+        return it != games.end() && it->second.identity == identity ? &it->second : nullptr;
+    }
+
+    void set(const GameSettings &settings) {
+        games[settings.identity.xxh64] = settings;
+    }
+
+    static std::string default_path() {
+        return user_directory("XDG_DATA_HOME", ".local/share") + "/games.db";
+    }
+
+private:
+    std::unordered_map<uint64_t, GameSettings> games;
+
+    static const char *mbc_name(int type) {
+        static const char *names[] = {"NONE", "MBC1", "MBC2", "MBC3", "MBC5"};
+        return type >= MBC_NONE && type <= MBC_5 ? names[type] : nullptr;
+    }
+
+    static bool parse(const std::string &line, GameSettings &settings) {
+        std::istringstream fields(line);
+        std::string crc, xxh;
+        if (!(fields >> crc >> xxh >> settings.identity.size))
+            return false;
+        settings.identity.crc32 = strtoul(crc.c_str(), nullptr, 16);
+        settings.identity.xxh64 = strtoull(xxh.c_str(), nullptr, 16);
+
+        std::string field;
+        while (fields >> field) {
+            size_t equals = field.find('=');
+            if (equals == std::string::npos)
+                return false;
+            std::string key = field.substr(0, equals);
+            std::string value = field.substr(equals + 1);
+
+            if (key == "title") {
+                settings.title = value;
+            } else if (key == "idle") {
+                std::istringstream list(value);
+                std::string address;
+                while (std::getline(list, address, ','))
+                    settings.idle_loops.push_back(strtoul(address.c_str(), nullptr, 16));
+            } else if (key == "mbc") {
+                for (int type = MBC_NONE; type <= MBC_5; type++)
+                    if (value == mbc_name(type))
+                        settings.mbc = type;
+            } else if (key == "quirks") {
+                if (value.find("mbc1m") != std::string::npos)
+                    settings.quirks |= QUIRK_MBC1_MULTICART;
+            }
+        }
+        return true;
+    }
+
+    static std::string format(const GameSettings &settings) {
+        char identity[64];
+        snprintf(identity, sizeof(identity), "%08x %016llx %llu", settings.identity.crc32,
+                 (unsigned long long)settings.identity.xxh64, (unsigned long long)settings.identity.size);
+
+        std::string line = identity;
+        if (!settings.title.empty()) {
+            std::string title = settings.title;
+            for (char &c : title)
+                if (c == ' ')
+                    c = '_';
+            line += " title=" + title;
+        }
+        for (size_t i = 0; i < settings.idle_loops.size(); i++) {
+            char address[8];
+            snprintf(address, sizeof(address), "0x%04X", settings.idle_loops[i]);
+            line += (i == 0 ? " idle=" : ",") + std::string(address);
+        }
+        if (mbc_name(settings.mbc))
+            line += std::string(" mbc=") + mbc_name(settings.mbc);
+        if (settings.quirks & QUIRK_MBC1_MULTICART)
+            line += " quirks=mbc1m";
+        return line;
+    }
+};
@@ -0,0 +1,314 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "../util/crc32.h"
+#include "../util/inflate.h"
+
+#define GZIP_MAGIC      0x8B1F
+#define ZIP_LOCAL_MAGIC 0x04034B50
+
+// gzip header flags
+#define GZIP_FHCRC      0x02
+#define GZIP_FEXTRA     0x04
+#define GZIP_FNAME      0x08
+#define GZIP_FCOMMENT   0x10
+
+// zip
+#define ZIP_STORED          0
+#define ZIP_DEFLATED        8
+#define ZIP_DATA_DESCRIPTOR 0x0008
+#define ZIP_ENCRYPTED       0x0001
+
+#define ARCHIVE_HEADER_SIZE 0x0150  // enough to size the ROM from its header
+#define ARCHIVE_MAX_ROM     0x800000    // largest size a header can promise
+
+inline uint16_t le16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+inline uint32_t le32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline bool is_gzip(const uint8_t *magic) {
+    return le16(magic) == GZIP_MAGIC;
+}
+
+inline bool is_zip(const uint8_t *magic) {
+    return le32(magic) == ZIP_LOCAL_MAGIC;
+}
+
+// Decompresses a .gz file or the first ROM in a .zip file from fd into an
+// anonymous mapping. The first ARCHIVE_HEADER_SIZE bytes go into a small
+// staging buffer; after that the mapping is sized by rom_size from them, so
+// a well formed ROM is inflated in place with no resize and no copy beyond
+// the header. Nothing is written to disk.
+class ROMArchive {
+public:
+    uint8_t *data = nullptr;
+    size_t size = 0;
+
+    // rom_size returns the size the header promises, 0 if it can't tell.
+    bool load(int fd, const char *filename, size_t (*_rom_size)(const uint8_t *header)) {
+        rom_size = _rom_size;
+        inflater.source = [fd](uint8_t *buf, size_t size) {
+            ssize_t got = ::read(fd, buf, size);
+            return got > 0 ? (size_t)got : 0;
+        };
+        inflater.grow = [this](size_t written, size_t &capacity) {
+            return grow(written, capacity);
+        };
+        inflater.out = staging;
+        inflater.capacity = ARCHIVE_HEADER_SIZE;
+
+        uint8_t magic[4];
+        bool ok = inflater.read(magic, 4);
+        if (ok && is_gzip(magic))
+            ok = load_gzip(magic);
+        else if (ok && is_zip(magic))
+            ok = load_zip();
+        else
+            ok = false;
+
+        if (ok && inflater.out == staging)
+            ok = (inflater.out = grow(inflater.written, inflater.capacity)) != nullptr;   // tiny ROM
+        if (!ok || !finish()) {
+            std::cout << "Failed to decompress " << filename << "\n";
+            release();
+            return false;
+        }
+        return true;
+    }
+
+    // Ownership of the mapping passes to the caller (munmap(data, size)).
+    void release() {
+        if (mapping)
+            munmap(mapping, mapping_size);
+        mapping = nullptr;
+        mapping_size = 0;
+    }
+
+private:
+    Inflater inflater;
+    size_t (*rom_size)(const uint8_t *header) = nullptr;
+    uint8_t staging[ARCHIVE_HEADER_SIZE];
+    uint8_t *mapping = nullptr;
+    size_t mapping_size = 0;
+
+    uint8_t *grow(size_t written, size_t &capacity) {
+        if (!mapping) {
+            // header complete, size the ROM from it. A stored block or a
+            // long match can need room before the header is in: then map the
+            // largest ROM size, untouched pages cost nothing and finish()
+            // trims the rest.
+            size_t length = written >= ARCHIVE_HEADER_SIZE ? rom_size(staging) : ARCHIVE_MAX_ROM;
+            if (length < 0x8000)
+                length = 0x8000;
+
+            void *map = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (map == MAP_FAILED)
+                return nullptr;
+            mapping = static_cast<uint8_t *>(map);
+            mapping_size = length;
+            memcpy(mapping, staging, written);
+        } else {
+            // bigger than the header said (odd sizes, overdumps)
+            void *map = mremap(mapping, mapping_size, mapping_size * 2, MREMAP_MAYMOVE);
+            if (map == MAP_FAILED)
+                return nullptr;
+            mapping = static_cast<uint8_t *>(map);
+            mapping_size *= 2;
+        }
+        capacity = mapping_size;
+        return mapping;
+    }
+
+    // Trims the mapping to the decompressed size and makes it read-only.
+    bool finish() {
+        size = inflater.written;
+        if (size < ARCHIVE_HEADER_SIZE)
+            return false;
+
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t used = (size + page - 1) & ~(page - 1);
+        if (used < mapping_size) {
+            munmap(mapping + used, mapping_size - used);
+            mapping_size = used;
+        }
+        if (mprotect(mapping, mapping_size, PROT_READ) < 0)
+            return false;
+
+        data = mapping;
+        mapping = nullptr;
+        mapping_size = 0;
+        return true;
+    }
+
+    bool skip_string() {
+        uint8_t c;
+        do {
+            if (!inflater.read(&c, 1))
+                return false;
+        } while (c);
+        return true;
+    }
+
+    bool load_gzip(const uint8_t *magic) {
+        uint8_t header[6];
+        if (magic[2] != 8 || !inflater.read(header, 6))     // 8: deflate
+            return false;
+
+        uint8_t flags = magic[3];
+        if (flags & GZIP_FEXTRA) {
+            uint8_t length[2];
+            if (!inflater.read(length, 2) || !inflater.skip(le16(length)))
+                return false;
+        }
+        if ((flags & GZIP_FNAME) && !skip_string())
+            return false;
+        if ((flags & GZIP_FCOMMENT) && !skip_string())
+            return false;
+        if ((flags & GZIP_FHCRC) && !inflater.skip(2))
+            return false;
+
+        uint8_t trailer[8];
+        if (!inflater.inflate() || !inflater.read(trailer, 8))
+            return false;
+        return le32(trailer) == crc32(0, inflater.out, inflater.written)
+            && le32(trailer + 4) == (uint32_t)inflater.written;
+    }
+
+    static bool is_rom_name(const std::string &name) {
+        size_t dot = name.rfind('.');
+        if (dot == std::string::npos)
+            return false;
+        std::string extension = name.substr(dot);
+        for (char &c : extension)
+            c = tolower(c);
+        return extension == ".gb" || extension == ".gbc" || extension == ".sgb";
+    }
+
+    // Sizes of 0xFFFFFFFF mean the real ones are in the zip64 extra field
+    // (what zip writes when it streams from a pipe).
+    static void zip64_sizes(const std::string &extra, uint64_t &uncompressed, uint64_t &compressed) {
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(extra.data());
+        size_t offset = 0;
+        while (offset + 4 <= extra.size()) {
+            uint16_t id = le16(p + offset);
+            uint16_t length = le16(p + offset + 2);
+            offset += 4;
+            if (id == 0x0001) {
+                size_t field = offset;
+                if (uncompressed == 0xFFFFFFFF && field + 8 <= offset + length) {
+                    uncompressed = le32(p + field) | ((uint64_t)le32(p + field + 4) << 32);
+                    field += 8;
+                }
+                if (compressed == 0xFFFFFFFF && field + 8 <= offset + length)
+                    compressed = le32(p + field) | ((uint64_t)le32(p + field + 4) << 32);
+            }
+            offset += length;
+        }
+    }
+
+    // Walks the local headers front to back and inflates the first ROM, so
+    // the central directory at the end of the file is never needed.
+    bool load_zip() {
+        bool first = true;
+        while (true) {
+            uint8_t header[30];
+            if (first) {
+                if (!inflater.read(header + 4, 26))
+                    return false;
+                first = false;
+            } else if (!inflater.read(header, 30) || le32(header) != ZIP_LOCAL_MAGIC) {
+                std::cout << "No ROM in zip\n";
+                return false;
+            }
+
+            uint16_t flags = le16(header + 6);
+            uint16_t method = le16(header + 8);
+            uint32_t crc = le32(header + 14);
+            uint64_t compressed = le32(header + 18);
+            uint64_t uncompressed = le32(header + 22);
+
+            std::string name(le16(header + 26), '\0');
+            std::string extra(le16(header + 28), '\0');
+            if (!inflater.read(reinterpret_cast<uint8_t *>(&name[0]), name.size())
+                || !inflater.read(reinterpret_cast<uint8_t *>(&extra[0]), extra.size()))
+                return false;
+            zip64_sizes(extra, uncompressed, compressed);
+
+            if (!is_rom_name(name)) {
+                // sizes are only in the data descriptor, can't skip it
+                if (flags & ZIP_DATA_DESCRIPTOR)
+                    return false;
+                if (!inflater.skip(compressed))
+                    return false;
+                continue;
+            }
+
+            if (flags & ZIP_ENCRYPTED)
+                return false;
+            if (method == ZIP_DEFLATED) {
+                if (!inflater.inflate())
+                    return false;
+            } else if (method == ZIP_STORED && !(flags & ZIP_DATA_DESCRIPTOR)) {
+                if (!copy_stored(uncompressed))
+                    return false;
+            } else {
+                return false;
+            }
+
+            if (flags & ZIP_DATA_DESCRIPTOR) {
+                // optional signature, crc, sizes
+                uint8_t descriptor[16];
+                if (!inflater.read(descriptor, 12))
+                    return false;
+                if (le32(descriptor) == 0x08074B50) {
+                    if (!inflater.read(descriptor + 12, 4))
+                        return false;
+                    crc = le32(descriptor + 4);
+                } else {
+                    crc = le32(descriptor);
+                }
+            } else if (uncompressed != inflater.written) {
+                return false;
+            }
+            return crc == crc32(0, inflater.out, inflater.written);
+        }
+    }
+
+    bool copy_stored(uint64_t length) {
+        uint8_t chunk[4096];
+        while (length > 0) {
+            size_t n = length < sizeof(chunk) ? length : sizeof(chunk);
+            if (!inflater.read(chunk, n) || !put(chunk, n))
+                return false;
+            length -= n;
+        }
+        return true;
+    }
+
+    bool put(const uint8_t *bytes, size_t n) {
+        while (n > 0) {
+            if (inflater.written == inflater.capacity
+                && !(inflater.out = grow(inflater.written, inflater.capacity)))
+                return false;
+            size_t part = inflater.capacity - inflater.written;
+            if (part > n)
+                part = n;
+            memcpy(inflater.out + inflater.written, bytes, part);
+            inflater.written += part;
+            bytes += part;
+            n -= part;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "../util/crc32.h"
+#include "../util/xxhash64.h"
+
+// What a ROM is, independent of its file name. CRC32 matches the usual ROM
+// set databases, XXH64 is the key everything local is stored under.
+struct ROMIdentity {
+    uint32_t crc32 = 0;
+    uint64_t xxh64 = 0;
+    uint64_t size = 0;
+
+    bool operator==(const ROMIdentity &other) const {
+        return crc32 == other.crc32 && xxh64 == other.xxh64 && size == other.size;
+    }
+
+    // "<crc32>-<xxh64>", e.g. for cache directory names.
+    std::string key() const {
+        char text[32];
+        snprintf(text, sizeof(text), "%08x-%016llx", crc32, (unsigned long long)xxh64);
+        return text;
+    }
+};
+
+inline ROMIdentity identify_rom(const uint8_t *data, size_t size) {
+    ROMIdentity identity;
+    identity.crc32 = crc32(0, data, size);
+    identity.xxh64 = xxhash64(data, size);
+    identity.size = size;
+    return identity;
+}
+
+// $XDG_<kind>_HOME/gbemu, or the XDG default under $HOME.
+inline std::string user_directory(const char *xdg_variable, const char *fallback) {
+    const char *xdg = getenv(xdg_variable);
+    if (xdg && *xdg)
+        return std::string(xdg) + "/gbemu";
+    const char *home = getenv("HOME");
+    return std::string(home ? home : ".") + "/" + fallback + "/gbemu";
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rom_archive.h"
+
+#define ROM_BANKS_ADDRESS   0x0148
+#define HEADER_END          0x0150
+
+// Banks promised by the ROM size byte (0x0148), 0 if the byte is invalid.
+inline uint32_t header_rom_banks(uint8_t rom_size) {
+    if (rom_size <= 0x08)
+        return 2u << rom_size;
+    switch (rom_size) {
+        case 0x52: return 72;
+        case 0x53: return 80;
+        case 0x54: return 96;
+        default:   return 0;
+    }
+}
+
+// A ROM file mapped read-only. Opening costs the same for any ROM size,
+// pages are only read in when touched, and every user of the image (header
+// parsing, the memory map) looks at the same pages instead of a copy.
+// Compressed ROMs (.gz, .zip) are inflated into an anonymous read-only
+// mapping instead, and are used the same way from then on.
+class ROMImage {
+public:
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    uint32_t banks = 0;
+
+    ROMImage() {}
+
+    ROMImage(const ROMImage &) = delete;
+    ROMImage &operator=(const ROMImage &) = delete;
+
+    ~ROMImage() {
+        close();
+    }
+
+    bool open(const char *filename) {
+        close();
+
+        int fd = ::open(filename, O_RDONLY);
+        if (fd < 0) {
+            std::cout << "Failed to open " << filename << "\n";
+            return false;
+        }
+
+        uint8_t magic[4] = {0};
+        if (pread(fd, magic, 4, 0) == 4 && (is_gzip(magic) || is_zip(magic))) {
+            ROMArchive archive;
+            bool ok = archive.load(fd, filename, [](const uint8_t *header) {
+                return header_rom_banks(header[ROM_BANKS_ADDRESS]) * (size_t)0x4000;
+            });
+            ::close(fd);
+            if (!ok)
+                return false;
+            data = archive.data;
+            size = archive.size;
+            return check_banks(filename);
+        }
+
+        bool ok = map(fd, filename);
+        ::close(fd);
+        return ok;
+    }
+
+    // Maps an already open file or memfd read-only. fd can be closed
+    // afterwards.
+    bool map(int fd, const char *name) {
+        close();
+
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size < HEADER_END) {
+            std::cout << "Not a ROM: " << name << "\n";
+            return false;
+        }
+
+        void *mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            std::cout << "Failed to map " << name << "\n";
+            return false;
+        }
+
+        data = static_cast<const uint8_t *>(mapping);
+        size = st.st_size;
+        return check_banks(name);
+    }
+
+    void close() {
+        if (data)
+            munmap(const_cast<uint8_t *>(data), size);
+        data = nullptr;
+        size = 0;
+        banks = 0;
+    }
+
+    bool is_open() const {
+        return data != nullptr;
+    }
+
+private:
+    bool check_banks(const char *filename) {
+        banks = header_rom_banks(data[ROM_BANKS_ADDRESS]);
+        if (banks == 0 || size < banks * 0x4000ull) {
+            std::cout << "ROM size " << size << " doesn't match header in " << filename << "\n";
+            close();
+            return false;
+        }
+        return true;
+    }
+};
+
+// Every instance in the process that opens the same file (same device,
+// inode, size and mtime, whatever the path) shares one read-only image;
+// it is unmapped when the last of them lets go.
+inline std::shared_ptr<const ROMImage> open_shared_rom(const char *filename) {
+    typedef std::tuple<dev_t, ino_t, off_t, int64_t> Key;
+    static std::mutex mutex;
+    static std::map<Key, std::weak_ptr<const ROMImage>> cache;
+
+    struct stat st;
+    if (stat(filename, &st) < 0) {
+        std::cout << "Failed to open " << filename << "\n";
+        return nullptr;
+    }
+    Key key(st.st_dev, st.st_ino, st.st_size, (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = cache.find(key);
+    if (it != cache.end()) {
+        if (std::shared_ptr<const ROMImage> image = it->second.lock())
+            return image;
+    }
+
+    std::shared_ptr<ROMImage> image = std::make_shared<ROMImage>();
+    if (!image->open(filename))
+        return nullptr;
+
+    for (auto entry = cache.begin(); entry != cache.end();)
+        entry = entry->second.expired() ? cache.erase(entry) : std::next(entry);
+    cache[key] = image;
+    return image;
+}
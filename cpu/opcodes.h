@@ -0,0 +1,388 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#define OPCODE_COUNT    0x200
+#define CB_OFFSET       0x100   // prefixed opcodes follow the 256 unprefixed ones
+
+// How the bytes after the opcode are read. Mnemonics name the operand with
+// the same d8/s8/d16/a16 notation as the CPU handlers, plus a8 for the low
+// byte of an 0xFF00 address.
+enum OperandFormat {
+    OPERAND_NONE,
+    OPERAND_D8,
+    OPERAND_D16,
+    OPERAND_A8,
+    OPERAND_A16,
+    OPERAND_S8,     // signed immediate
+    OPERAND_R8,     // signed offset from the next instruction (JR)
+};
+
+// Where execution goes after the instruction, other than the next one.
+enum ControlFlow {
+    FLOW_NEXT,
+    FLOW_JUMP,
+    FLOW_JUMP_HL,   // JP HL, target only known at run time
+    FLOW_CALL,
+    FLOW_RETURN,
+    FLOW_RESTART,   // RST, target is opcode & 0x38
+    FLOW_ILLEGAL,   // locks up the CPU
+};
+
+struct OpcodeInfo {
+    char mnemonic[12];
+    OperandFormat operand;
+    uint8_t length;         // bytes, including the opcode (and 0xCB prefix)
+    uint8_t cycles;         // M-cycles, branch not taken
+    uint8_t taken_cycles;   // M-cycles, branch taken (same as cycles if unconditional)
+    char flags[5];          // Z N H C: '-' kept, '0'/'1' reset/set, letter computed
+    ControlFlow flow;
+
+    bool conditional() const {
+        return taken_cycles != cycles;
+    }
+};
+
+// Unprefixed opcodes. 0xCB has no cost of its own, the prefixed opcode's
+// cycles include the prefix.
+constexpr OpcodeInfo BASE_OPCODES[0x100] = {
+    {"NOP",          OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x00
+    {"LD BC,d16",    OPERAND_D16,  3, 3, 3, "----", FLOW_NEXT},  // 0x01
+    {"LD (BC),A",    OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x02
+    {"INC BC",       OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x03
+    {"INC B",        OPERAND_NONE, 1, 1, 1, "Z0H-", FLOW_NEXT},  // 0x04
+    {"DEC B",        OPERAND_NONE, 1, 1, 1, "Z1H-", FLOW_NEXT},  // 0x05
+    {"LD B,d8",      OPERAND_D8,   2, 2, 2, "----", FLOW_NEXT},  // 0x06
+    {"RLCA",         OPERAND_NONE, 1, 1, 1, "000C", FLOW_NEXT},  // 0x07
+    {"LD (a16),SP",  OPERAND_A16,  3, 5, 5, "----", FLOW_NEXT},  // 0x08
+    {"ADD HL,BC",    OPERAND_NONE, 1, 2, 2, "-0HC", FLOW_NEXT},  // 0x09
+    {"LD A,(BC)",    OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x0A
+    {"DEC BC",       OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x0B
+    {"INC C",        OPERAND_NONE, 1, 1, 1, "Z0H-", FLOW_NEXT},  // 0x0C
+    {"DEC C",        OPERAND_NONE, 1, 1, 1, "Z1H-", FLOW_NEXT},  // 0x0D
+    {"LD C,d8",      OPERAND_D8,   2, 2, 2, "----", FLOW_NEXT},  // 0x0E
+    {"RRCA",         OPERAND_NONE, 1, 1, 1, "000C", FLOW_NEXT},  // 0x0F
+    {"STOP",         OPERAND_NONE, 2, 1, 1, "----", FLOW_NEXT},  // 0x10
+    {"LD DE,d16",    OPERAND_D16,  3, 3, 3, "----", FLOW_NEXT},  // 0x11
+    {"LD (DE),A",    OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x12
+    {"INC DE",       OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x13
+    {"INC D",        OPERAND_NONE, 1, 1, 1, "Z0H-", FLOW_NEXT},  // 0x14
+    {"DEC D",        OPERAND_NONE, 1, 1, 1, "Z1H-", FLOW_NEXT},  // 0x15
+    {"LD D,d8",      OPERAND_D8,   2, 2, 2, "----", FLOW_NEXT},  // 0x16
+    {"RLA",          OPERAND_NONE, 1, 1, 1, "000C", FLOW_NEXT},  // 0x17
+    {"JR s8",        OPERAND_R8,   2, 3, 3, "----", FLOW_JUMP},  // 0x18
+    {"ADD HL,DE",    OPERAND_NONE, 1, 2, 2, "-0HC", FLOW_NEXT},  // 0x19
+    {"LD A,(DE)",    OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x1A
+    {"DEC DE",       OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x1B
+    {"INC E",        OPERAND_NONE, 1, 1, 1, "Z0H-", FLOW_NEXT},  // 0x1C
+    {"DEC E",        OPERAND_NONE, 1, 1, 1, "Z1H-", FLOW_NEXT},  // 0x1D
+    {"LD E,d8",      OPERAND_D8,   2, 2, 2, "----", FLOW_NEXT},  // 0x1E
+    {"RRA",          OPERAND_NONE, 1, 1, 1, "000C", FLOW_NEXT},  // 0x1F
+    {"JR NZ,s8",     OPERAND_R8,   2, 2, 3, "----", FLOW_JUMP},  // 0x20
+    {"LD HL,d16",    OPERAND_D16,  3, 3, 3, "----", FLOW_NEXT},  // 0x21
+    {"LD (HL+),A",   OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x22
+    {"INC HL",       OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x23
+    {"INC H",        OPERAND_NONE, 1, 1, 1, "Z0H-", FLOW_NEXT},  // 0x24
+    {"DEC H",        OPERAND_NONE, 1, 1, 1, "Z1H-", FLOW_NEXT},  // 0x25
+    {"LD H,d8",      OPERAND_D8,   2, 2, 2, "----", FLOW_NEXT},  // 0x26
+    {"DAA",          OPERAND_NONE, 1, 1, 1, "Z-0C", FLOW_NEXT},  // 0x27
+    {"JR Z,s8",      OPERAND_R8,   2, 2, 3, "----", FLOW_JUMP},  // 0x28
+    {"ADD HL,HL",    OPERAND_NONE, 1, 2, 2, "-0HC", FLOW_NEXT},  // 0x29
+    {"LD A,(HL+)",   OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x2A
+    {"DEC HL",       OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x2B
+    {"INC L",        OPERAND_NONE, 1, 1, 1, "Z0H-", FLOW_NEXT},  // 0x2C
+    {"DEC L",        OPERAND_NONE, 1, 1, 1, "Z1H-", FLOW_NEXT},  // 0x2D
+    {"LD L,d8",      OPERAND_D8,   2, 2, 2, "----", FLOW_NEXT},  // 0x2E
+    {"CPL",          OPERAND_NONE, 1, 1, 1, "-11-", FLOW_NEXT},  // 0x2F
+    {"JR NC,s8",     OPERAND_R8,   2, 2, 3, "----", FLOW_JUMP},  // 0x30
+    {"LD SP,d16",    OPERAND_D16,  3, 3, 3, "----", FLOW_NEXT},  // 0x31
+    {"LD (HL-),A",   OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x32
+    {"INC SP",       OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x33
+    {"INC (HL)",     OPERAND_NONE, 1, 3, 3, "Z0H-", FLOW_NEXT},  // 0x34
+    {"DEC (HL)",     OPERAND_NONE, 1, 3, 3, "Z1H-", FLOW_NEXT},  // 0x35
+    {"LD (HL),d8",   OPERAND_D8,   2, 3, 3, "----", FLOW_NEXT},  // 0x36
+    {"SCF",          OPERAND_NONE, 1, 1, 1, "-001", FLOW_NEXT},  // 0x37
+    {"JR C,s8",      OPERAND_R8,   2, 2, 3, "----", FLOW_JUMP},  // 0x38
+    {"ADD HL,SP",    OPERAND_NONE, 1, 2, 2, "-0HC", FLOW_NEXT},  // 0x39
+    {"LD A,(HL-)",   OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x3A
+    {"DEC SP",       OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x3B
+    {"INC A",        OPERAND_NONE, 1, 1, 1, "Z0H-", FLOW_NEXT},  // 0x3C
+    {"DEC A",        OPERAND_NONE, 1, 1, 1, "Z1H-", FLOW_NEXT},  // 0x3D
+    {"LD A,d8",      OPERAND_D8,   2, 2, 2, "----", FLOW_NEXT},  // 0x3E
+    {"CCF",          OPERAND_NONE, 1, 1, 1, "-00C", FLOW_NEXT},  // 0x3F
+    {"LD B,B",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x40
+    {"LD B,C",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x41
+    {"LD B,D",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x42
+    {"LD B,E",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x43
+    {"LD B,H",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x44
+    {"LD B,L",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x45
+    {"LD B,(HL)",    OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x46
+    {"LD B,A",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x47
+    {"LD C,B",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x48
+    {"LD C,C",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x49
+    {"LD C,D",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x4A
+    {"LD C,E",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x4B
+    {"LD C,H",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x4C
+    {"LD C,L",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x4D
+    {"LD C,(HL)",    OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x4E
+    {"LD C,A",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x4F
+    {"LD D,B",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x50
+    {"LD D,C",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x51
+    {"LD D,D",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x52
+    {"LD D,E",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x53
+    {"LD D,H",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x54
+    {"LD D,L",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x55
+    {"LD D,(HL)",    OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x56
+    {"LD D,A",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x57
+    {"LD E,B",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x58
+    {"LD E,C",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x59
+    {"LD E,D",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x5A
+    {"LD E,E",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x5B
+    {"LD E,H",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x5C
+    {"LD E,L",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x5D
+    {"LD E,(HL)",    OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x5E
+    {"LD E,A",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x5F
+    {"LD H,B",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x60
+    {"LD H,C",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x61
+    {"LD H,D",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x62
+    {"LD H,E",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x63
+    {"LD H,H",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x64
+    {"LD H,L",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x65
+    {"LD H,(HL)",    OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x66
+    {"LD H,A",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x67
+    {"LD L,B",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x68
+    {"LD L,C",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x69
+    {"LD L,D",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x6A
+    {"LD L,E",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x6B
+    {"LD L,H",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x6C
+    {"LD L,L",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x6D
+    {"LD L,(HL)",    OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x6E
+    {"LD L,A",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x6F
+    {"LD (HL),B",    OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x70
+    {"LD (HL),C",    OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x71
+    {"LD (HL),D",    OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x72
+    {"LD (HL),E",    OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x73
+    {"LD (HL),H",    OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x74
+    {"LD (HL),L",    OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x75
+    {"HALT",         OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x76
+    {"LD (HL),A",    OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x77
+    {"LD A,B",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x78
+    {"LD A,C",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x79
+    {"LD A,D",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x7A
+    {"LD A,E",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x7B
+    {"LD A,H",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x7C
+    {"LD A,L",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x7D
+    {"LD A,(HL)",    OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0x7E
+    {"LD A,A",       OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0x7F
+    {"ADD A,B",      OPERAND_NONE, 1, 1, 1, "Z0HC", FLOW_NEXT},  // 0x80
+    {"ADD A,C",      OPERAND_NONE, 1, 1, 1, "Z0HC", FLOW_NEXT},  // 0x81
+    {"ADD A,D",      OPERAND_NONE, 1, 1, 1, "Z0HC", FLOW_NEXT},  // 0x82
+    {"ADD A,E",      OPERAND_NONE, 1, 1, 1, "Z0HC", FLOW_NEXT},  // 0x83
+    {"ADD A,H",      OPERAND_NONE, 1, 1, 1, "Z0HC", FLOW_NEXT},  // 0x84
+    {"ADD A,L",      OPERAND_NONE, 1, 1, 1, "Z0HC", FLOW_NEXT},  // 0x85
+    {"ADD A,(HL)",   OPERAND_NONE, 1, 2, 2, "Z0HC", FLOW_NEXT},  // 0x86
+    {"ADD A,A",      OPERAND_NONE, 1, 1, 1, "Z0HC", FLOW_NEXT},  // 0x87
+    {"ADC A,B",      OPERAND_NONE, 1, 1, 1, "Z0HC", FLOW_NEXT},  // 0x88
+    {"ADC A,C",      OPERAND_NONE, 1, 1, 1, "Z0HC", FLOW_NEXT},  // 0x89
+    {"ADC A,D",      OPERAND_NONE, 1, 1, 1, "Z0HC", FLOW_NEXT},  // 0x8A
+    {"ADC A,E",      OPERAND_NONE, 1, 1, 1, "Z0HC", FLOW_NEXT},  // 0x8B
+    {"ADC A,H",      OPERAND_NONE, 1, 1, 1, "Z0HC", FLOW_NEXT},  // 0x8C
+    {"ADC A,L",      OPERAND_NONE, 1, 1, 1, "Z0HC", FLOW_NEXT},  // 0x8D
+    {"ADC A,(HL)",   OPERAND_NONE, 1, 2, 2, "Z0HC", FLOW_NEXT},  // 0x8E
+    {"ADC A,A",      OPERAND_NONE, 1, 1, 1, "Z0HC", FLOW_NEXT},  // 0x8F
+    {"SUB A,B",      OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0x90
+    {"SUB A,C",      OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0x91
+    {"SUB A,D",      OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0x92
+    {"SUB A,E",      OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0x93
+    {"SUB A,H",      OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0x94
+    {"SUB A,L",      OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0x95
+    {"SUB A,(HL)",   OPERAND_NONE, 1, 2, 2, "Z1HC", FLOW_NEXT},  // 0x96
+    {"SUB A,A",      OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0x97
+    {"SBC A,B",      OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0x98
+    {"SBC A,C",      OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0x99
+    {"SBC A,D",      OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0x9A
+    {"SBC A,E",      OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0x9B
+    {"SBC A,H",      OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0x9C
+    {"SBC A,L",      OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0x9D
+    {"SBC A,(HL)",   OPERAND_NONE, 1, 2, 2, "Z1HC", FLOW_NEXT},  // 0x9E
+    {"SBC A,A",      OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0x9F
+    {"AND A,B",      OPERAND_NONE, 1, 1, 1, "Z010", FLOW_NEXT},  // 0xA0
+    {"AND A,C",      OPERAND_NONE, 1, 1, 1, "Z010", FLOW_NEXT},  // 0xA1
+    {"AND A,D",      OPERAND_NONE, 1, 1, 1, "Z010", FLOW_NEXT},  // 0xA2
+    {"AND A,E",      OPERAND_NONE, 1, 1, 1, "Z010", FLOW_NEXT},  // 0xA3
+    {"AND A,H",      OPERAND_NONE, 1, 1, 1, "Z010", FLOW_NEXT},  // 0xA4
+    {"AND A,L",      OPERAND_NONE, 1, 1, 1, "Z010", FLOW_NEXT},  // 0xA5
+    {"AND A,(HL)",   OPERAND_NONE, 1, 2, 2, "Z010", FLOW_NEXT},  // 0xA6
+    {"AND A,A",      OPERAND_NONE, 1, 1, 1, "Z010", FLOW_NEXT},  // 0xA7
+    {"XOR A,B",      OPERAND_NONE, 1, 1, 1, "Z000", FLOW_NEXT},  // 0xA8
+    {"XOR A,C",      OPERAND_NONE, 1, 1, 1, "Z000", FLOW_NEXT},  // 0xA9
+    {"XOR A,D",      OPERAND_NONE, 1, 1, 1, "Z000", FLOW_NEXT},  // 0xAA
+    {"XOR A,E",      OPERAND_NONE, 1, 1, 1, "Z000", FLOW_NEXT},  // 0xAB
+    {"XOR A,H",      OPERAND_NONE, 1, 1, 1, "Z000", FLOW_NEXT},  // 0xAC
+    {"XOR A,L",      OPERAND_NONE, 1, 1, 1, "Z000", FLOW_NEXT},  // 0xAD
+    {"XOR A,(HL)",   OPERAND_NONE, 1, 2, 2, "Z000", FLOW_NEXT},  // 0xAE
+    {"XOR A,A",      OPERAND_NONE, 1, 1, 1, "Z000", FLOW_NEXT},  // 0xAF
+    {"OR A,B",       OPERAND_NONE, 1, 1, 1, "Z000", FLOW_NEXT},  // 0xB0
+    {"OR A,C",       OPERAND_NONE, 1, 1, 1, "Z000", FLOW_NEXT},  // 0xB1
+    {"OR A,D",       OPERAND_NONE, 1, 1, 1, "Z000", FLOW_NEXT},  // 0xB2
+    {"OR A,E",       OPERAND_NONE, 1, 1, 1, "Z000", FLOW_NEXT},  // 0xB3
+    {"OR A,H",       OPERAND_NONE, 1, 1, 1, "Z000", FLOW_NEXT},  // 0xB4
+    {"OR A,L",       OPERAND_NONE, 1, 1, 1, "Z000", FLOW_NEXT},  // 0xB5
+    {"OR A,(HL)",    OPERAND_NONE, 1, 2, 2, "Z000", FLOW_NEXT},  // 0xB6
+    {"OR A,A",       OPERAND_NONE, 1, 1, 1, "Z000", FLOW_NEXT},  // 0xB7
+    {"CP A,B",       OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0xB8
+    {"CP A,C",       OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0xB9
+    {"CP A,D",       OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0xBA
+    {"CP A,E",       OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0xBB
+    {"CP A,H",       OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0xBC
+    {"CP A,L",       OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0xBD
+    {"CP A,(HL)",    OPERAND_NONE, 1, 2, 2, "Z1HC", FLOW_NEXT},  // 0xBE
+    {"CP A,A",       OPERAND_NONE, 1, 1, 1, "Z1HC", FLOW_NEXT},  // 0xBF
+    {"RET NZ",       OPERAND_NONE, 1, 2, 5, "----", FLOW_RETURN},  // 0xC0
+    {"POP BC",       OPERAND_NONE, 1, 3, 3, "----", FLOW_NEXT},  // 0xC1
+    {"JP NZ,a16",    OPERAND_A16,  3, 3, 4, "----", FLOW_JUMP},  // 0xC2
+    {"JP a16",       OPERAND_A16,  3, 4, 4, "----", FLOW_JUMP},  // 0xC3
+    {"CALL NZ,a16",  OPERAND_A16,  3, 3, 6, "----", FLOW_CALL},  // 0xC4
+    {"PUSH BC",      OPERAND_NONE, 1, 4, 4, "----", FLOW_NEXT},  // 0xC5
+    {"ADD A,d8",     OPERAND_D8,   2, 2, 2, "Z0HC", FLOW_NEXT},  // 0xC6
+    {"RST 00H",      OPERAND_NONE, 1, 4, 4, "----", FLOW_RESTART},  // 0xC7
+    {"RET Z",        OPERAND_NONE, 1, 2, 5, "----", FLOW_RETURN},  // 0xC8
+    {"RET",          OPERAND_NONE, 1, 4, 4, "----", FLOW_RETURN},  // 0xC9
+    {"JP Z,a16",     OPERAND_A16,  3, 3, 4, "----", FLOW_JUMP},  // 0xCA
+    {"PREFIX CB",    OPERAND_NONE, 1, 0, 0, "----", FLOW_NEXT},  // 0xCB
+    {"CALL Z,a16",   OPERAND_A16,  3, 3, 6, "----", FLOW_CALL},  // 0xCC
+    {"CALL a16",     OPERAND_A16,  3, 6, 6, "----", FLOW_CALL},  // 0xCD
+    {"ADC A,d8",     OPERAND_D8,   2, 2, 2, "Z0HC", FLOW_NEXT},  // 0xCE
+    {"RST 08H",      OPERAND_NONE, 1, 4, 4, "----", FLOW_RESTART},  // 0xCF
+    {"RET NC",       OPERAND_NONE, 1, 2, 5, "----", FLOW_RETURN},  // 0xD0
+    {"POP DE",       OPERAND_NONE, 1, 3, 3, "----", FLOW_NEXT},  // 0xD1
+    {"JP NC,a16",    OPERAND_A16,  3, 3, 4, "----", FLOW_JUMP},  // 0xD2
+    {"ILLEGAL_D3",   OPERAND_NONE, 1, 1, 1, "----", FLOW_ILLEGAL},  // 0xD3
+    {"CALL NC,a16",  OPERAND_A16,  3, 3, 6, "----", FLOW_CALL},  // 0xD4
+    {"PUSH DE",      OPERAND_NONE, 1, 4, 4, "----", FLOW_NEXT},  // 0xD5
+    {"SUB A,d8",     OPERAND_D8,   2, 2, 2, "Z1HC", FLOW_NEXT},  // 0xD6
+    {"RST 10H",      OPERAND_NONE, 1, 4, 4, "----", FLOW_RESTART},  // 0xD7
+    {"RET C",        OPERAND_NONE, 1, 2, 5, "----", FLOW_RETURN},  // 0xD8
+    {"RETI",         OPERAND_NONE, 1, 4, 4, "----", FLOW_RETURN},  // 0xD9
+    {"JP C,a16",     OPERAND_A16,  3, 3, 4, "----", FLOW_JUMP},  // 0xDA
+    {"ILLEGAL_DB",   OPERAND_NONE, 1, 1, 1, "----", FLOW_ILLEGAL},  // 0xDB
+    {"CALL C,a16",   OPERAND_A16,  3, 3, 6, "----", FLOW_CALL},  // 0xDC
+    {"ILLEGAL_DD",   OPERAND_NONE, 1, 1, 1, "----", FLOW_ILLEGAL},  // 0xDD
+    {"SBC A,d8",     OPERAND_D8,   2, 2, 2, "Z1HC", FLOW_NEXT},  // 0xDE
+    {"RST 18H",      OPERAND_NONE, 1, 4, 4, "----", FLOW_RESTART},  // 0xDF
+    {"LDH (a8),A",   OPERAND_A8,   2, 3, 3, "----", FLOW_NEXT},  // 0xE0
+    {"POP HL",       OPERAND_NONE, 1, 3, 3, "----", FLOW_NEXT},  // 0xE1
+    {"LDH (C),A",    OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0xE2
+    {"ILLEGAL_E3",   OPERAND_NONE, 1, 1, 1, "----", FLOW_ILLEGAL},  // 0xE3
+    {"ILLEGAL_E4",   OPERAND_NONE, 1, 1, 1, "----", FLOW_ILLEGAL},  // 0xE4
+    {"PUSH HL",      OPERAND_NONE, 1, 4, 4, "----", FLOW_NEXT},  // 0xE5
+    {"AND A,d8",     OPERAND_D8,   2, 2, 2, "Z010", FLOW_NEXT},  // 0xE6
+    {"RST 20H",      OPERAND_NONE, 1, 4, 4, "----", FLOW_RESTART},  // 0xE7
+    {"ADD SP,s8",    OPERAND_S8,   2, 4, 4, "00HC", FLOW_NEXT},  // 0xE8
+    {"JP HL",        OPERAND_NONE, 1, 1, 1, "----", FLOW_JUMP_HL},  // 0xE9
+    {"LD (a16),A",   OPERAND_A16,  3, 4, 4, "----", FLOW_NEXT},  // 0xEA
+    {"ILLEGAL_EB",   OPERAND_NONE, 1, 1, 1, "----", FLOW_ILLEGAL},  // 0xEB
+    {"ILLEGAL_EC",   OPERAND_NONE, 1, 1, 1, "----", FLOW_ILLEGAL},  // 0xEC
+    {"ILLEGAL_ED",   OPERAND_NONE, 1, 1, 1, "----", FLOW_ILLEGAL},  // 0xED
+    {"XOR A,d8",     OPERAND_D8,   2, 2, 2, "Z000", FLOW_NEXT},  // 0xEE
+    {"RST 28H",      OPERAND_NONE, 1, 4, 4, "----", FLOW_RESTART},  // 0xEF
+    {"LDH A,(a8)",   OPERAND_A8,   2, 3, 3, "----", FLOW_NEXT},  // 0xF0
+    {"POP AF",       OPERAND_NONE, 1, 3, 3, "ZNHC", FLOW_NEXT},  // 0xF1
+    {"LDH A,(C)",    OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0xF2
+    {"DI",           OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0xF3
+    {"ILLEGAL_F4",   OPERAND_NONE, 1, 1, 1, "----", FLOW_ILLEGAL},  // 0xF4
+    {"PUSH AF",      OPERAND_NONE, 1, 4, 4, "----", FLOW_NEXT},  // 0xF5
+    {"OR A,d8",      OPERAND_D8,   2, 2, 2, "Z000", FLOW_NEXT},  // 0xF6
+    {"RST 30H",      OPERAND_NONE, 1, 4, 4, "----", FLOW_RESTART},  // 0xF7
+    {"LD HL,SP+s8",  OPERAND_S8,   2, 3, 3, "00HC", FLOW_NEXT},  // 0xF8
+    {"LD SP,HL",     OPERAND_NONE, 1, 2, 2, "----", FLOW_NEXT},  // 0xF9
+    {"LD A,(a16)",   OPERAND_A16,  3, 4, 4, "----", FLOW_NEXT},  // 0xFA
+    {"EI",           OPERAND_NONE, 1, 1, 1, "----", FLOW_NEXT},  // 0xFB
+    {"ILLEGAL_FC",   OPERAND_NONE, 1, 1, 1, "----", FLOW_ILLEGAL},  // 0xFC
+    {"ILLEGAL_FD",   OPERAND_NONE, 1, 1, 1, "----", FLOW_ILLEGAL},  // 0xFD
+    {"CP A,d8",      OPERAND_D8,   2, 2, 2, "Z1HC", FLOW_NEXT},  // 0xFE
+    {"RST 38H",      OPERAND_NONE, 1, 4, 4, "----", FLOW_RESTART},  // 0xFF
+};
+
+// The 0xCB opcodes are regular: bits 6-7 pick the group, 3-5 the
+// operation or bit, 0-2 the register.
+constexpr std::array<OpcodeInfo, OPCODE_COUNT> opcode_table() {
+    constexpr const char *registers[8] = {"B", "C", "D", "E", "H", "L", "(HL)", "A"};
+    constexpr const char *shifts[8] = {"RLC", "RRC", "RL", "RR", "SLA", "SRA", "SWAP", "SRL"};
+    constexpr const char *groups[4] = {"", "BIT", "RES", "SET"};
+
+    std::array<OpcodeInfo, OPCODE_COUNT> table{};
+    for (int op = 0; op < 0x100; op++)
+        table[op] = BASE_OPCODES[op];
+
+    for (int op = 0; op < 0x100; op++) {
+        OpcodeInfo &info = table[CB_OFFSET + op];
+        int group = op >> 6;
+        int index = (op >> 3) & 7;
+        bool hl = (op & 7) == 6;
+
+        // "<op> <reg>" or "<op> <bit>,<reg>"
+        const char *name = group ? groups[group] : shifts[index];
+        int n = 0;
+        for (const char *c = name; *c; c++)
+            info.mnemonic[n++] = *c;
+        info.mnemonic[n++] = ' ';
+        if (group) {
+            info.mnemonic[n++] = '0' + index;
+            info.mnemonic[n++] = ',';
+        }
+        for (const char *c = registers[op & 7]; *c; c++)
+            info.mnemonic[n++] = *c;
+
+        const char *flags = group == 0 ? (index == 6 ? "Z000" : "Z00C")
+                          : group == 1 ? "Z01-" : "----";
+        for (int i = 0; i < 5; i++)
+            info.flags[i] = flags[i];
+
+        info.operand = OPERAND_NONE;
+        info.length = 2;
+        info.cycles = hl ? (group == 1 ? 3 : 4) : 2;
+        info.taken_cycles = info.cycles;
+        info.flow = FLOW_NEXT;
+    }
+    return table;
+}
+
+inline constexpr std::array<OpcodeInfo, OPCODE_COUNT> OPCODES = opcode_table();
+
+// The instruction starting at bytes.
+inline const OpcodeInfo &opcode_info(const uint8_t *bytes) {
+    return bytes[0] == 0xCB ? OPCODES[CB_OFFSET + bytes[1]] : OPCODES[bytes[0]];
+}
+
+// Text of the instruction at bytes, with its operand filled in. address is
+// where it sits, for relative jumps. bytes must hold the whole instruction.
+inline std::string disassemble(const uint8_t *bytes, uint16_t address) {
+    static const char *tokens[] = {"", "d8", "d16", "a8", "a16", "s8", "s8"};
+    const OpcodeInfo &info = opcode_info(bytes);
+    uint16_t d16 = bytes[1] | (bytes[2] << 8);
+    int8_t s8 = static_cast<int8_t>(bytes[1]);
+    char operand[8];
+
+    switch (info.operand) {
+        case OPERAND_D8:  snprintf(operand, sizeof(operand), "$%02X", bytes[1]); break;
+        case OPERAND_D16: snprintf(operand, sizeof(operand), "$%04X", d16); break;
+        case OPERAND_A8:  snprintf(operand, sizeof(operand), "$FF%02X", bytes[1]); break;
+        case OPERAND_A16: snprintf(operand, sizeof(operand), "$%04X", d16); break;
+        case OPERAND_S8:  snprintf(operand, sizeof(operand), "%+d", s8); break;
+        case OPERAND_R8:  snprintf(operand, sizeof(operand), "$%04X", (uint16_t)(address + 2 + s8)); break;
+        default:          return info.mnemonic;
+    }
+
+    std::string text = info.mnemonic;
+    size_t token = text.find(tokens[info.operand]);
+    size_t length = std::char_traits<char>::length(tokens[info.operand]);
+    if (info.operand == OPERAND_S8 && token > 0 && text[token - 1] == '+') {
+        token--;    // SP+s8: the sign comes with the number
+        length++;
+    }
+    return text.replace(token, length, operand);
+}
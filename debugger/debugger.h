@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "../memory/memory.h"
+
+enum StopReason {
+    STOP_NONE,
+    STOP_BREAKPOINT,
+    STOP_WATCH_READ,
+    STOP_WATCH_WRITE,
+    STOP_STEP,          // reached the run-to / step-over target
+};
+
+#define BANK_WORDS      (ROM_BANK_SIZE / 64)
+#define RAM_WORDS       (0x8000 / 64)
+#define ADDRESS_WORDS   (0x10000 / 64)
+
+// Run loop policy without a debugger. Every hook is a constant, so the
+// instantiated loop has no checks left in it.
+struct NoDebugger {
+    bool breakpoint(uint16_t, Memory &) {
+        return false;
+    }
+
+    bool stopped() {
+        return false;
+    }
+};
+
+// Run loop policy with breakpoints and watchpoints.
+//
+// PC breakpoints are a bit per address: one bitmap per ROM bank (allocated
+// on the first breakpoint in it) for 0x0000-0x7FFF, found through the bank
+// the page table currently maps, and one for 0x8000-0xFFFF.
+//
+// Watchpoints take their page out of Memory's page tables, so only accesses
+// to watched pages leave the fast path; the bitmap then picks out the
+// watched bytes.
+class Debugger : public MemoryWatcher {
+public:
+    StopReason reason = STOP_NONE;
+    uint16_t stop_address = 0;
+    uint8_t stop_value = 0;
+
+    Debugger(Memory *_memory) : memory(_memory), ram_bits(RAM_WORDS, 0),
+                                watch_read_bits(ADDRESS_WORDS, 0), watch_write_bits(ADDRESS_WORDS, 0) {
+        memory->watcher = this;
+    }
+
+    ~Debugger() {
+        for (uint32_t address = 0; address < 0x10000; address++)
+            remove_watchpoint(address);
+        memory->watcher = nullptr;
+    }
+
+    Debugger(const Debugger &) = delete;
+    Debugger &operator=(const Debugger &) = delete;
+
+    // bank picks the ROM bank for 0x0000-0x7FFF, -1 for the one mapped now.
+    void add_breakpoint(uint16_t address, int bank = -1) {
+        std::vector<uint64_t> &bits = bitmap(address, bank);
+        if (bits.empty())
+            bits.assign(BANK_WORDS, 0);
+        uint16_t offset = address < 0x8000 ? address & 0x3FFF : address - 0x8000;
+        bits[offset >> 6] |= 1ull << (offset & 63);
+    }
+
+    void remove_breakpoint(uint16_t address, int bank = -1) {
+        std::vector<uint64_t> &bits = bitmap(address, bank);
+        uint16_t offset = address < 0x8000 ? address & 0x3FFF : address - 0x8000;
+        if (!bits.empty())
+            bits[offset >> 6] &= ~(1ull << (offset & 63));
+    }
+
+    void add_watchpoint(uint16_t address, bool reads, bool writes) {
+        reads = reads && !test(watch_read_bits, address);
+        writes = writes && !test(watch_write_bits, address);
+        if (reads)
+            watch_read_bits[address >> 6] |= 1ull << (address & 63);
+        if (writes)
+            watch_write_bits[address >> 6] |= 1ull << (address & 63);
+        if (reads || writes)
+            memory->watch(address >> PAGE_SHIFT, reads, writes);
+    }
+
+    void remove_watchpoint(uint16_t address) {
+        bool reads = test(watch_read_bits, address);
+        bool writes = test(watch_write_bits, address);
+        watch_read_bits[address >> 6] &= ~(1ull << (address & 63));
+        watch_write_bits[address >> 6] &= ~(1ull << (address & 63));
+        if (reads || writes)
+            memory->unwatch(address >> PAGE_SHIFT, reads, writes);
+    }
+
+    // One-shot stop at address, for run-to and step-over.
+    void run_to(uint16_t address) {
+        temporary = address;
+    }
+
+    void cancel_run_to() {
+        temporary = -1;
+    }
+
+    void resume() {
+        reason = STOP_NONE;
+        hit = false;
+    }
+
+    // ---- POLICY ----
+
+    bool breakpoint(uint16_t pc, Memory &mem) {
+        if (pc == temporary) {
+            temporary = -1;
+            return stop(STOP_STEP, pc, 0);
+        }
+
+        const std::vector<uint64_t> *bits;
+        uint16_t offset;
+        if (pc < 0x8000) {
+            const uint8_t *mapped = pc < 0x4000 ? mem.ROM_bank_00 : mem.ROM_bank_01_NN;
+            size_t bank = (mapped - mem.ROM) / ROM_BANK_SIZE;
+            if (bank >= rom_bits.size())
+                return false;
+            bits = &rom_bits[bank];
+            offset = pc & 0x3FFF;
+        } else {
+            bits = &ram_bits;
+            offset = pc - 0x8000;
+        }
+
+        if (bits->empty() || !(((*bits)[offset >> 6] >> (offset & 63)) & 1))
+            return false;
+        return stop(STOP_BREAKPOINT, pc, 0);
+    }
+
+    bool stopped() {
+        return hit;
+    }
+
+    // ---- WATCHER ----
+
+    void watched_read(uint16_t address, uint8_t value) override {
+        if (test(watch_read_bits, address))
+            stop(STOP_WATCH_READ, address, value);
+    }
+
+    void watched_write(uint16_t address, uint8_t value) override {
+        if (test(watch_write_bits, address))
+            stop(STOP_WATCH_WRITE, address, value);
+    }
+
+private:
+    Memory *memory;
+    std::vector<std::vector<uint64_t>> rom_bits;
+    std::vector<uint64_t> ram_bits;
+    std::vector<uint64_t> watch_read_bits;
+    std::vector<uint64_t> watch_write_bits;
+    int temporary = -1;
+    bool hit = false;
+
+    std::vector<uint64_t> &bitmap(uint16_t address, int bank) {
+        if (address >= 0x8000)
+            return ram_bits;
+        if (bank < 0) {
+            const uint8_t *mapped = address < 0x4000 ? memory->ROM_bank_00 : memory->ROM_bank_01_NN;
+            bank = (mapped - memory->ROM) / ROM_BANK_SIZE;
+        }
+        if ((size_t)bank >= rom_bits.size())
+            rom_bits.resize(bank + 1);
+        return rom_bits[bank];
+    }
+
+    static bool test(const std::vector<uint64_t> &bits, uint16_t address) {
+        return (bits[address >> 6] >> (address & 63)) & 1;
+    }
+
+    bool stop(StopReason _reason, uint16_t address, uint8_t value) {
+        reason = _reason;
+        stop_address = address;
+        stop_value = value;
+        hit = true;
+        return true;
+    }
+};
@@ -0,0 +1,105 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+
+#include "../cartridge/game_db.h"
+#include "../cartridge/rom_identity.h"
+#include "../cartridge/rom_image.h"
+#include "disassembler.h"
+
+static bool open_rom(const char *file, ROMImage &image, Disassembly &disassembly, double &milliseconds) {
+    if (!image.open(file))
+        return false;
+
+    auto start = std::chrono::steady_clock::now();
+    disassembly.analyze(image.data, image.size);
+    milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+static int list(const char *file) {
+    ROMImage image;
+    Disassembly disassembly;
+    double milliseconds;
+    if (!open_rom(file, image, disassembly, milliseconds))
+        return 1;
+
+    disassembly.print(stdout);
+    return 0;
+}
+
+static int stats(const char *file) {
+    ROMImage image;
+    Disassembly disassembly;
+    double milliseconds;
+    if (!open_rom(file, image, disassembly, milliseconds))
+        return 1;
+
+    uint32_t code = disassembly.code_bytes();
+    std::cout << "ROM size:     " << image.size << " bytes, " << image.banks << " banks\n"
+              << "Code:         " << code << " bytes\n"
+              << "Data:         " << image.size - code << " bytes\n"
+              << "Instructions: " << disassembly.instructions << "\n"
+              << "Blocks:       " << disassembly.blocks << "\n"
+              << "Far jumps:    " << disassembly.far_jumps << " (bank unknown)\n"
+              << "Idle loops:   " << disassembly.idle_loops().size() << "\n"
+              << "Analysis:     " << milliseconds << " ms\n";
+    return 0;
+}
+
+// Prints the idle loop candidates and, with --db, adds them to the game's
+// settings so the CPU skips them from the next load on.
+static int idle(const char *file, int argc, char **argv) {
+    std::string db_file;
+    for (int i = 0; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--db" && i + 1 < argc)  db_file = argv[++i];
+        else if (arg == "--db")             db_file = GameDB::default_path();
+    }
+
+    ROMImage image;
+    Disassembly disassembly;
+    double milliseconds;
+    if (!open_rom(file, image, disassembly, milliseconds))
+        return 1;
+
+    std::vector<uint16_t> loops = disassembly.idle_loops();
+    for (uint16_t address : loops)
+        printf("0x%04X  %s\n", address, disassemble(image.data + address, address).c_str());
+    std::cout << loops.size() << " idle loops\n";
+    if (db_file.empty())
+        return 0;
+
+    GameDB games;
+    games.load(db_file.c_str());
+    ROMIdentity identity = identify_rom(image.data, image.size);
+    const GameSettings *existing = games.find(identity);
+    GameSettings settings = existing ? *existing : GameSettings();
+    settings.identity = identity;
+    for (uint16_t address : loops) {
+        if (std::find(settings.idle_loops.begin(), settings.idle_loops.end(), address) == settings.idle_loops.end())
+            settings.idle_loops.push_back(address);
+    }
+    games.set(settings);
+
+    if (!games.save(db_file.c_str())) {
+        std::cout << "Failed to write " << db_file << "\n";
+        return 1;
+    }
+    std::cout << "Saved to " << db_file << "\n";
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 3 && std::string(argv[1]) == "list")
+        return list(argv[2]);
+    if (argc == 3 && std::string(argv[1]) == "stats")
+        return stats(argv[2]);
+    if (argc >= 3 && std::string(argv[1]) == "idle")
+        return idle(argv[2], argc - 3, argv + 3);
+
+    std::cout << "Usage: disassembler list <rom>\n"
+              << "       disassembler stats <rom>\n"
+              << "       disassembler idle <rom> [--db [FILE]]\n";
+    return 1;
+}
@@ -0,0 +1,257 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "../cpu/opcodes.h"
+#include "../memory/mbc.h"
+
+// Disassembly marks, one byte of them per ROM byte
+#define MARK_CODE       0x01    // part of an instruction
+#define MARK_START      0x02    // first byte of an instruction
+#define MARK_TARGET     0x04    // jumped to, called or an RST vector
+#define MARK_BLOCK      0x08    // a basic block starts here
+#define MARK_ENTRY      0x10    // entry point or interrupt vector
+
+#define IDLE_LOOP_MAX   16      // longest loop body considered, in bytes
+
+// Static analysis of a whole ROM. Control flow is followed from the entry
+// point and the RST/interrupt vectors, every reachable instruction is
+// marked, and whatever is never reached counts as data.
+//
+// Code in bank 0 can't know which bank is mapped at 0x4000-0x7FFF. A
+// "LD A,d8 / LD (2000-3FFF),A" pair earlier on the same path names it; otherwise
+// the jump is counted in far_jumps and not followed. ROMs with only two
+// banks have no choice to make.
+class Disassembly {
+public:
+    std::vector<uint8_t> marks;
+    uint32_t instructions = 0;
+    uint32_t blocks = 0;
+    uint32_t far_jumps = 0;
+
+    void analyze(const uint8_t *_rom, size_t _size) {
+        rom = _rom;
+        size = _size;
+        banks = std::max<size_t>(1, size / ROM_BANK_SIZE);
+        marks.assign(size, 0);
+        instructions = blocks = far_jumps = 0;
+
+        std::vector<Trace> pending;
+        for (uint16_t vector = 0x00; vector <= 0x60; vector += 0x08)
+            seed(pending, vector);
+        seed(pending, 0x0100);
+
+        while (!pending.empty()) {
+            Trace next = pending.back();
+            pending.pop_back();
+            trace(pending, next);
+        }
+
+        for (uint8_t mark : marks)
+            blocks += (mark & (MARK_BLOCK | MARK_START)) == (MARK_BLOCK | MARK_START);
+    }
+
+    uint32_t code_bytes() const {
+        return std::count_if(marks.begin(), marks.end(), [](uint8_t mark) { return mark & MARK_CODE; });
+    }
+
+    // Address a ROM offset is seen at by the CPU.
+    static uint16_t cpu_address(uint32_t offset) {
+        return offset < ROM_BANK_SIZE ? offset : ROM_BANK_SIZE | (offset & (ROM_BANK_SIZE - 1));
+    }
+
+    // Loops that only poll memory an interrupt handler changes, like
+    // "wait: LD A,(C0A0); AND A; JR Z,wait" for a flag the VBlank handler
+    // sets. Nothing in the loop body changes state of its own, so the CPU
+    // can skip to the next event. Only addresses that always hold the same
+    // code are reported: bank 0, or any bank of a 32 KiB ROM.
+    std::vector<uint16_t> idle_loops() const {
+        std::vector<uint16_t> loops;
+        size_t limit = banks <= 2 ? size : std::min<size_t>(size, ROM_BANK_SIZE);
+
+        for (uint32_t offset = 0; offset < limit; offset++) {
+            if ((marks[offset] & (MARK_BLOCK | MARK_START)) == (MARK_BLOCK | MARK_START) && is_idle_loop(offset))
+                loops.push_back(cpu_address(offset));
+        }
+        return loops;
+    }
+
+    // Assembly listing, bank by bank. Unreached bytes are printed as db
+    // lines of up to 16 bytes.
+    void print(FILE *out) const {
+        char line[128];
+        for (uint32_t offset = 0; offset < size;) {
+            if ((offset & (ROM_BANK_SIZE - 1)) == 0)
+                fprintf(out, "\nSECTION \"ROM Bank $%02X\"\n", offset / ROM_BANK_SIZE);
+
+            uint32_t bank = offset / ROM_BANK_SIZE;
+            uint16_t address = cpu_address(offset);
+            uint8_t mark = marks[offset];
+
+            if (mark & MARK_BLOCK)
+                fputc('\n', out);
+            if (mark & MARK_TARGET)
+                fprintf(out, "L%02X_%04X:\n", bank, address);
+
+            int length;
+            if (mark & MARK_START) {
+                length = opcode_info(rom + offset).length;
+                std::string text = disassemble(rom + offset, address);
+                int n = snprintf(line, sizeof(line), "    %-20s ; %02X:%04X ", text.c_str(), bank, address);
+                for (int i = 0; i < length; i++)
+                    n += snprintf(line + n, sizeof(line) - n, " %02X", rom[offset + i]);
+            } else {
+                // up to the next instruction, label or 16 bytes
+                length = 1;
+                while (length < 16 && offset + length < size && !(marks[offset + length] & (MARK_START | MARK_BLOCK)) &&
+                       ((offset + length) & (ROM_BANK_SIZE - 1)) != 0)
+                    length++;
+                int n = snprintf(line, sizeof(line), "    db ");
+                for (int i = 0; i < length; i++)
+                    n += snprintf(line + n, sizeof(line) - n, i ? ",$%02X" : "$%02X", rom[offset + i]);
+            }
+            fputs(line, out);
+            fputc('\n', out);
+            offset += length;
+        }
+    }
+
+private:
+    struct Trace {
+        uint32_t offset;
+        int high_bank;  // bank at 0x4000-0x7FFF, -1 if unknown
+    };
+
+    const uint8_t *rom = nullptr;
+    size_t size = 0;
+    size_t banks = 0;
+
+    void seed(std::vector<Trace> &pending, uint16_t address) {
+        if (address >= size)
+            return;
+        marks[address] |= MARK_ENTRY | MARK_TARGET | MARK_BLOCK;
+        pending.push_back({address, banks == 2 ? 1 : -1});
+    }
+
+    // ROM offset of address with high_bank mapped, -1 outside the ROM.
+    int64_t resolve(uint16_t address, int high_bank) const {
+        if (address < ROM_BANK_SIZE)
+            return address;
+        if (address >= 2 * ROM_BANK_SIZE || high_bank < 0)
+            return -1;
+        uint64_t offset = (uint64_t)high_bank * ROM_BANK_SIZE + (address - ROM_BANK_SIZE);
+        return offset < size ? (int64_t)offset : -1;
+    }
+
+    // Decodes straight-line code from start until it ends or reaches code
+    // that was already decoded, queueing every branch target on the way.
+    void trace(std::vector<Trace> &pending, Trace start) {
+        uint32_t offset = start.offset;
+        int high_bank = start.high_bank;
+        int last_a = -1;    // A from an LD A,d8 just before, for bank switches
+
+        while (!(marks[offset] & MARK_START)) {
+            // an instruction can't run on past the end of its bank
+            uint32_t bank_end = std::min<size_t>((offset & ~(ROM_BANK_SIZE - 1)) + ROM_BANK_SIZE, size);
+            if (rom[offset] == 0xCB && offset + 1 >= bank_end)
+                return;
+            const OpcodeInfo &info = opcode_info(rom + offset);
+            uint32_t next = offset + info.length;
+            if (next > bank_end)
+                return;
+
+            marks[offset] |= MARK_START;
+            for (uint32_t i = offset; i < next; i++)
+                marks[i] |= MARK_CODE;
+            instructions++;
+
+            uint8_t opcode = rom[offset];
+            uint16_t d16 = info.length == 3 ? rom[offset + 1] | (rom[offset + 2] << 8) : 0;
+            if (opcode == 0xEA && d16 >= 0x2000 && d16 < 0x4000 && last_a >= 0)
+                high_bank = last_a ? last_a % banks : 1;
+            last_a = opcode == 0x3E ? rom[offset + 1] : -1;
+
+            int target = -1;
+            if (info.flow == FLOW_RESTART)
+                target = opcode & 0x38;
+            else if ((info.flow == FLOW_JUMP || info.flow == FLOW_CALL) && info.operand == OPERAND_R8)
+                target = (uint16_t)(cpu_address(offset) + 2 + static_cast<int8_t>(rom[offset + 1]));
+            else if (info.flow == FLOW_JUMP || info.flow == FLOW_CALL)
+                target = d16;
+
+            if (target >= 0) {
+                int64_t resolved = resolve(target, high_bank);
+                if (resolved >= 0) {
+                    marks[resolved] |= MARK_TARGET | MARK_BLOCK;
+                    int bank = resolved >= ROM_BANK_SIZE ? resolved / ROM_BANK_SIZE : high_bank;
+                    pending.push_back({(uint32_t)resolved, bank});
+                } else if (target >= ROM_BANK_SIZE && target < 2 * ROM_BANK_SIZE) {
+                    far_jumps++;
+                }
+            }
+
+            bool falls_through = info.flow == FLOW_NEXT || info.flow == FLOW_CALL ||
+                                 info.flow == FLOW_RESTART || info.conditional();
+            if (!falls_through || next >= bank_end)
+                return;
+            if (info.flow != FLOW_NEXT)
+                marks[next] |= MARK_BLOCK;
+            offset = next;
+        }
+    }
+
+    // Reads of WRAM/HRAM/IF, compares and tests, ending in a branch back to
+    // the start.
+    bool is_idle_loop(uint32_t start) const {
+        uint16_t address = cpu_address(start);
+        uint32_t end = std::min<size_t>(size, start + IDLE_LOOP_MAX);
+
+        for (uint32_t offset = start; offset < end;) {
+            if (!(marks[offset] & MARK_START))
+                return false;
+            const OpcodeInfo &info = opcode_info(rom + offset);
+
+            if (info.flow == FLOW_JUMP) {
+                uint16_t target = info.operand == OPERAND_R8
+                    ? (uint16_t)(cpu_address(offset) + 2 + static_cast<int8_t>(rom[offset + 1]))
+                    : rom[offset + 1] | (rom[offset + 2] << 8);
+                return target == address;
+            }
+            if (!idle_opcode(rom + offset))
+                return false;
+            offset += info.length;
+        }
+        return false;
+    }
+
+    // Only memory that changes when an interrupt is taken or an event runs
+    // counts. DIV, TIMA, STAT and LY move between events, and reads through
+    // (HL), (BC), (DE) or (C) could be anywhere.
+    static bool idle_address(uint16_t address) {
+        return (address >= 0xC000 && address < 0xE000) ||     // WRAM
+               (address >= 0xFF80 && address < 0xFFFF) ||     // HRAM
+               address == 0xFF0F;                              // IF
+    }
+
+    static bool idle_opcode(const uint8_t *bytes) {
+        uint8_t opcode = bytes[0];
+        switch (opcode) {
+            case 0x00:                                  // NOP
+            case 0xE6: case 0xF6: case 0xFE:            // AND/OR/CP d8
+                return true;
+            case 0xF0:                                  // LDH A,(a8)
+                return idle_address(0xFF00 | bytes[1]);
+            case 0xFA:                                  // LD A,(a16)
+                return idle_address(bytes[1] | (bytes[2] << 8));
+            case 0xCB:                                  // BIT b,r
+                return bytes[1] >= 0x40 && bytes[1] < 0x80 && (bytes[1] & 7) != 6;
+            default:
+                // AND/OR r repeat to the same result, CP changes nothing
+                return ((opcode >= 0xA0 && opcode < 0xA8) || (opcode >= 0xB0 && opcode < 0xC0)) && (opcode & 7) != 6;
+        }
+    }
+};
@@ -0,0 +1,252 @@
+#include <atomic>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../cartridge/cartridge.h"
+#include "rom_index.h"
+
+namespace fs = std::filesystem;
+
+struct ScanJob {
+    std::string path;
+    int64_t mtime;
+    uint64_t size;
+    const IndexEntry *previous;     // unchanged since the last index, or null
+};
+
+static bool is_rom(const fs::path &path) {
+    std::string extension = path.extension().string();
+    for (char &c : extension)
+        c = tolower(c);
+    return extension == ".gb" || extension == ".gbc" || extension == ".sgb";
+}
+
+static int64_t mtime_ns(const struct stat &st) {
+    return (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+// Reads only the 0x0100-0x014F header page and fills entry from it.
+static bool read_header(const std::string &path, IndexEntry &entry) {
+    uint8_t header[HEADER_END] = {0};
+
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    ssize_t got = pread(fd, header + 0x0100, HEADER_END - 0x0100, 0x0100);
+    close(fd);
+    if (got != HEADER_END - 0x0100)
+        return false;
+
+    Cartridge cart(header, HEADER_END, path.c_str());
+
+    memcpy(entry.title, header + TITLE, sizeof(entry.title));
+    memcpy(entry.new_licensee, header + NEW_LICENSEE, 2);
+    entry.old_licensee = header[OLD_LICENSEE];
+    entry.CGB_flag = cart.CGB_flag;
+    entry.SGB_flag = cart.SGB_flag;
+    entry.cartridge_type = header[CART_TYPE];
+    entry.ROM_size = header[ROM_BANKS];
+    entry.RAM_size = header[RAM_SIZE];
+    entry.flags = 0;
+    if (cart.logo_valid())
+        entry.flags |= INDEX_LOGO_OK;
+    if (cart.header_checksum_valid())
+        entry.flags |= INDEX_HEADER_OK;
+    return true;
+}
+
+// Collects the ROMs under root. Walks one directory at a time, since a
+// recursive_directory_iterator ends for good at the first error; here an
+// unreadable directory is reported and the rest of the tree still scanned.
+// Symlinked directories aren't followed.
+static void scan(const fs::path &root, const RomIndex &previous, std::vector<ScanJob> &jobs) {
+    std::vector<fs::path> pending{root};
+    while (!pending.empty()) {
+        fs::path directory = pending.back();
+        pending.pop_back();
+
+        std::error_code error;
+        fs::directory_iterator it(directory, fs::directory_options::skip_permission_denied, error), end;
+        for (; !error && it != end; it.increment(error)) {
+            std::error_code status_error;
+            if (it->is_directory(status_error) && !it->is_symlink(status_error)) {
+                pending.push_back(it->path());
+                continue;
+            }
+            if (!it->is_regular_file(status_error) || !is_rom(it->path()))
+                continue;
+
+            ScanJob job;
+            job.path = fs::absolute(it->path()).lexically_normal().string();
+            struct stat st;
+            if (stat(job.path.c_str(), &st) < 0)
+                continue;
+            job.mtime = mtime_ns(st);
+            job.size = st.st_size;
+
+            job.previous = previous.find(job.path);
+            if (job.previous && (job.previous->mtime != job.mtime || job.previous->size != job.size))
+                job.previous = nullptr;
+            jobs.push_back(job);
+        }
+        if (error)
+            std::cout << "Failed to scan " << directory.string() << ": " << error.message() << "\n";
+    }
+}
+
+// Walks the directories, reuses entries whose mtime and size haven't
+// changed and reads the remaining headers on all cores.
+static int build(const char *index_file, char **directories, int directory_count) {
+    RomIndex previous;
+    previous.open(index_file);
+
+    std::vector<ScanJob> jobs;
+    for (int i = 0; i < directory_count; i++)
+        scan(directories[i], previous, jobs);
+
+    std::vector<IndexEntry> entries(jobs.size());
+    std::vector<char> valid(jobs.size(), 0);
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> scanned{0};
+
+    auto worker = [&]() {
+        size_t i;
+        while ((i = next++) < jobs.size()) {
+            ScanJob &job = jobs[i];
+            IndexEntry &entry = entries[i];
+            if (job.previous) {
+                entry = *job.previous;
+                valid[i] = 1;
+                continue;
+            }
+
+            memset(&entry, 0, sizeof(entry));
+            entry.mtime = job.mtime;
+            entry.size = job.size;
+            valid[i] = read_header(job.path, entry);
+            scanned++;
+        }
+    };
+
+    int thread_count = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::thread> threads;
+    for (int i = 0; i < thread_count; i++)
+        threads.emplace_back(worker);
+    for (std::thread &thread : threads)
+        thread.join();
+
+    std::vector<IndexEntry> table;
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (!valid[i])
+            continue;
+        table.push_back(entries[i]);
+        paths.push_back(jobs[i].path);
+    }
+
+    previous.close();
+    if (!RomIndex::write(index_file, table, paths)) {
+        std::cout << "Failed to write " << index_file << "\n";
+        return 1;
+    }
+
+    std::cout << "Indexed " << table.size() << " ROMs (" << scanned << " read, "
+              << table.size() - scanned << " unchanged)\n";
+    return 0;
+}
+
+static std::string entry_title(const IndexEntry &entry) {
+    return std::string(entry.title, strnlen(entry.title, TITLE_LENGTH));
+}
+
+static void print_entry(const RomIndex &index, const IndexEntry &entry) {
+    std::cout << index.path(entry) << "\n";
+    std::cout << "  Title: " << entry_title(entry) << "\n";
+    std::cout << "  Developer: " << licensee_name(entry.old_licensee, entry.new_licensee[0], entry.new_licensee[1]) << "\n";
+    std::cout << "  Cartridge Type: " << cartridge_type_name(entry.cartridge_type) << "\n";
+    std::cout << "  ROM Banks: " << (int)header_rom_banks(entry.ROM_size)
+              << "  RAM Size: 0x" << std::hex << (int)entry.RAM_size << std::dec
+              << "  CGB: 0x" << std::hex << (int)entry.CGB_flag << std::dec << "\n";
+    std::cout << "  Logo: " << ((entry.flags & INDEX_LOGO_OK) ? "ok" : "bad")
+              << "  Header checksum: " << ((entry.flags & INDEX_HEADER_OK) ? "ok" : "bad") << "\n";
+}
+
+// list <index> [--type HEX] [--cgb] [--title TEXT] [--bad]
+static int usage() {
+    std::cout << "Usage: indexer build <index> <directory>...\n"
+              << "       indexer list <index> [--type HEX] [--cgb] [--title TEXT] [--bad]\n"
+              << "       indexer find <index> <rom>\n";
+    return 1;
+}
+
+static int list(const char *index_file, int argc, char **argv) {
+    int type = -1;
+    bool cgb_only = false, bad_only = false;
+    std::string title;
+    for (int i = 0; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--type" && i + 1 < argc) {
+            char *end;
+            type = strtol(argv[++i], &end, 16);
+            if (end == argv[i] || *end || type < 0 || type > 0xFF)
+                return usage();
+        } else if (arg == "--title" && i + 1 < argc)  title = argv[++i];
+        else if (arg == "--cgb")                    cgb_only = true;
+        else if (arg == "--bad")                    bad_only = true;
+    }
+
+    RomIndex index;
+    if (!index.open(index_file)) {
+        std::cout << "Failed to open index " << index_file << "\n";
+        return 1;
+    }
+
+    int matches = 0;
+    for (uint32_t i = 0; i < index.count; i++) {
+        const IndexEntry &entry = index.entries[i];
+        if (type >= 0 && entry.cartridge_type != type)
+            continue;
+        if (cgb_only && !(entry.CGB_flag & 0x80))
+            continue;
+        if (bad_only && (entry.flags & (INDEX_LOGO_OK | INDEX_HEADER_OK)) == (INDEX_LOGO_OK | INDEX_HEADER_OK))
+            continue;
+        if (!title.empty() && entry_title(entry).find(title) == std::string::npos)
+            continue;
+
+        std::cout << index.path(entry) << "\t" << entry_title(entry) << "\n";
+        matches++;
+    }
+    std::cout << matches << " of " << index.count << " ROMs\n";
+    return 0;
+}
+
+static int find(const char *index_file, const char *file) {
+    RomIndex index;
+    if (!index.open(index_file)) {
+        std::cout << "Failed to open index " << index_file << "\n";
+        return 1;
+    }
+
+    std::string path = fs::absolute(file).lexically_normal().string();
+    const IndexEntry *entry = index.find(path);
+    if (!entry) {
+        std::cout << "Not indexed: " << path << "\n";
+        return 1;
+    }
+    print_entry(index, *entry);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 4 && std::string(argv[1]) == "build")
+        return build(argv[2], argv + 3, argc - 3);
+    if (argc >= 3 && std::string(argv[1]) == "list")
+        return list(argv[2], argc - 3, argv + 3);
+    if (argc == 4 && std::string(argv[1]) == "find")
+        return find(argv[2], argv[3]);
+
+    return usage();
+}
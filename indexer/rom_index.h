@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define INDEX_MAGIC     "GBIX"
+#define INDEX_VERSION   1
+
+// IndexEntry flags
+#define INDEX_LOGO_OK       0x01
+#define INDEX_HEADER_OK     0x02
+
+struct IndexHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t count;
+    uint32_t strings_size;
+};
+
+// Raw header fields, decoded to names only when displayed. Fixed size so
+// the whole table can be used straight from the mapping.
+struct IndexEntry {
+    int64_t mtime;          // ns, for incremental rescans
+    uint64_t size;
+    uint32_t path_offset;   // into the string table
+    uint32_t path_length;
+    char title[16];         // 0x0134 - 0x0143
+    char new_licensee[2];
+    uint8_t old_licensee;
+    uint8_t CGB_flag;
+    uint8_t SGB_flag;
+    uint8_t cartridge_type;
+    uint8_t ROM_size;
+    uint8_t RAM_size;
+    uint8_t flags;
+    uint8_t reserved[7];
+};
+
+// Index file: header, entries sorted by path, then the path strings.
+class RomIndex {
+public:
+    const IndexEntry *entries = nullptr;
+    uint32_t count = 0;
+
+    RomIndex() {}
+
+    RomIndex(const RomIndex &) = delete;
+    RomIndex &operator=(const RomIndex &) = delete;
+
+    ~RomIndex() {
+        close();
+    }
+
+    bool open(const char *filename) {
+        close();
+
+        int fd = ::open(filename, O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(IndexHeader)) {
+            ::close(fd);
+            return false;
+        }
+
+        void *data = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED)
+            return false;
+
+        mapping = static_cast<const uint8_t *>(data);
+        mapping_size = st.st_size;
+
+        const IndexHeader *header = reinterpret_cast<const IndexHeader *>(mapping);
+        size_t expected = sizeof(IndexHeader) + (size_t)header->count * sizeof(IndexEntry) + header->strings_size;
+        if (memcmp(header->magic, INDEX_MAGIC, 4) != 0 || header->version != INDEX_VERSION
+            || expected != mapping_size) {
+            close();
+            return false;
+        }
+
+        count = header->count;
+        entries = reinterpret_cast<const IndexEntry *>(mapping + sizeof(IndexHeader));
+        strings = reinterpret_cast<const char *>(entries + count);
+
+        // path() trusts these, so a damaged index is refused here
+        for (uint32_t i = 0; i < count; i++) {
+            if ((uint64_t)entries[i].path_offset + entries[i].path_length > header->strings_size) {
+                close();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void close() {
+        if (mapping)
+            munmap(const_cast<uint8_t *>(mapping), mapping_size);
+        mapping = nullptr;
+        entries = nullptr;
+        count = 0;
+    }
+
+    std::string_view path(const IndexEntry &entry) const {
+        return std::string_view(strings + entry.path_offset, entry.path_length);
+    }
+
+    // Binary search on the sorted paths.
+    const IndexEntry *find(std::string_view file) const {
+        const IndexEntry *end = entries + count;
+        const IndexEntry *it = std::lower_bound(entries, end, file,
+            [this](const IndexEntry &entry, std::string_view key) { return path(entry) < key; });
+        return (it != end && path(*it) == file) ? it : nullptr;
+    }
+
+    // Writes entries (path_offset/path_length are filled in here) to a
+    // temporary file and renames it over filename, so readers never see a
+    // half written index.
+    static bool write(const char *filename, std::vector<IndexEntry> &table, std::vector<std::string> &paths) {
+        std::vector<uint32_t> order(table.size());
+        for (uint32_t i = 0; i < order.size(); i++)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return paths[a] < paths[b]; });
+
+        std::vector<IndexEntry> sorted;
+        std::string string_table;
+        sorted.reserve(table.size());
+        for (uint32_t i : order) {
+            IndexEntry entry = table[i];
+            entry.path_offset = string_table.size();
+            entry.path_length = paths[i].size();
+            string_table += paths[i];
+            sorted.push_back(entry);
+        }
+
+        IndexHeader header;
+        memcpy(header.magic, INDEX_MAGIC, 4);
+        header.version = INDEX_VERSION;
+        header.count = sorted.size();
+        header.strings_size = string_table.size();
+
+        std::string temporary = std::string(filename) + ".tmp";
+        FILE *fp = fopen(temporary.c_str(), "wb");
+        if (!fp)
+            return false;
+
+        bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+               && fwrite(sorted.data(), sizeof(IndexEntry), sorted.size(), fp) == sorted.size()
+               && fwrite(string_table.data(), 1, string_table.size(), fp) == string_table.size();
+        ok = fclose(fp) == 0 && ok;
+
+        return ok && rename(temporary.c_str(), filename) == 0;
+    }
+
+private:
+    const uint8_t *mapping = nullptr;
+    size_t mapping_size = 0;
+    const char *strings = nullptr;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../movie/movie.h"
+
+#define P1      0xFF00
+
+// Button bits in a joypad state / movie frame
+#define BUTTON_RIGHT    0x01
+#define BUTTON_LEFT     0x02
+#define BUTTON_UP       0x04
+#define BUTTON_DOWN     0x08
+#define BUTTON_A        0x10
+#define BUTTON_B        0x20
+#define BUTTON_SELECT   0x40
+#define BUTTON_START    0x80
+
+#define P1_DIRECTIONS   0x10    // 0 = selected
+#define P1_ACTIONS      0x20
+
+enum MovieMode {
+    MOVIE_OFF,
+    MOVIE_RECORD,
+    MOVIE_PLAY
+};
+
+// Input only changes on frame boundaries, whether it comes from the host,
+// is being recorded, or is played back, so a movie replays exactly.
+class Joypad {
+public:
+    MovieMode mode = MOVIE_OFF;
+
+    uint8_t read() {
+        uint8_t lines = 0x0F;
+        if (!(select & P1_DIRECTIONS)) lines &= ~buttons;
+        if (!(select & P1_ACTIONS))    lines &= ~(buttons >> 4);
+        return 0xC0 | select | lines;
+    }
+
+    void write(uint8_t value) {
+        select = value & 0x30;
+    }
+
+    // Host input, takes effect at the next frame boundary.
+    void press(uint8_t state) {
+        next = state;
+    }
+
+    void record(Movie *_movie) {
+        movie = _movie;
+        movie->frames.clear();
+        mode = MOVIE_RECORD;
+    }
+
+    void play(Movie *_movie) {
+        movie = _movie;
+        frame = 0;
+        mode = MOVIE_PLAY;
+    }
+
+    // Playback ran out of frames.
+    bool finished() {
+        return mode == MOVIE_PLAY && frame >= movie->frames.size();
+    }
+
+    // Called by the frame event. Returns true if a button went down (joypad
+    // interrupt).
+    bool next_frame() {
+        if (mode == MOVIE_PLAY)
+            next = frame < movie->frames.size() ? movie->frames[frame++] : 0;
+        else if (mode == MOVIE_RECORD)
+            movie->frames.push_back(next);
+
+        uint8_t pressed = next & ~buttons;
+        buttons = next;
+        return pressed != 0;
+    }
+
+private:
+    uint8_t buttons = 0;
+    uint8_t next = 0;
+    uint8_t select = 0x30;
+    Movie *movie = nullptr;
+    size_t frame = 0;
+};
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../util/fnv1a.h"
+
+#define ROM_BANK_SIZE   0x4000
+#define RAM_BANK_SIZE   0x2000
+#define MBC2_RAM_SIZE   0x200
+
+#define CART_TYPE_ADDRESS   0x0147
+#define RAM_SIZE_ADDRESS    0x0149
+
+enum MBCType {
+    MBC_NONE,
+    MBC_1,
+    MBC_2,
+    MBC_3,
+    MBC_5
+};
+
+// Cartridge type byte (0x0147) to the controller that has to be emulated.
+inline MBCType mbc_type(uint8_t cartridge_type) {
+    switch (cartridge_type) {
+        case 0x01: case 0x02: case 0x03:
+            return MBC_1;
+        case 0x05: case 0x06:
+            return MBC_2;
+        case 0x0F: case 0x10: case 0x11: case 0x12: case 0x13:
+            return MBC_3;
+        case 0x19: case 0x1A: case 0x1B: case 0x1C: case 0x1D: case 0x1E:
+            return MBC_5;
+        default:
+            return MBC_NONE;
+    }
+}
+
+// MBC3+TIMER types carry a real-time clock.
+inline bool has_rtc(uint8_t cartridge_type) {
+    return cartridge_type == 0x0F || cartridge_type == 0x10;
+}
+
+// RAM size byte (0x0149) to the number of 8 KiB banks.
+inline int ram_banks(uint8_t ram_size) {
+    static const int banks[6] = {0, 0, 1, 4, 16, 8};
+    return ram_size < 6 ? banks[ram_size] : 0;
+}
+
+// Most 8 KiB RAM banks the controller can select. MBC2 has its own 512
+// nibbles instead.
+inline int max_ram_banks(MBCType type) {
+    switch (type) {
+        case MBC_NONE:  return 1;
+        case MBC_1:     return 4;
+        case MBC_2:     return 0;
+        case MBC_3:     return 8;   // MBC30
+        default:        return 16;
+    }
+}
+
+// Bank controller registers. The controller only decides which banks are
+// mapped, Memory turns that into page pointers, so a bank switch is a
+// couple of pointer assignments.
+class MBC {
+public:
+    MBCType type = MBC_NONE;
+    int rom_banks = 2;
+    int ram_banks = 0;
+    bool rtc = false;
+
+    bool ram_enabled = false;
+    uint16_t rom_bank = 1;
+    uint8_t ram_bank = 0;
+    uint8_t bank_upper = 0;     // MBC1 2-bit register
+    bool mode = false;          // MBC1 banking mode
+    bool multicart = false;     // MBC1M wiring: upper bits start at bank 0x10
+
+    uint64_t state_hash(uint64_t hash) const {
+        hash = fnv1a_value(type, hash);
+        hash = fnv1a_value(ram_enabled, hash);
+        hash = fnv1a_value(rom_bank, hash);
+        hash = fnv1a_value(ram_bank, hash);
+        hash = fnv1a_value(bank_upper, hash);
+        hash = fnv1a_value(mode, hash);
+        return fnv1a_value(multicart, hash);
+    }
+
+    // A write into 0x0000-0x7FFF.
+    void write(uint16_t address, uint8_t value) {
+        switch (type) {
+            case MBC_1:
+                if (address < 0x2000)       ram_enabled = (value & 0x0F) == 0x0A;
+                else if (address < 0x4000)  rom_bank = (value & 0x1F) ? (value & 0x1F) : 1;
+                else if (address < 0x6000)  bank_upper = value & 0x03;
+                else                        mode = value & 0x01;
+                break;
+            case MBC_2:
+                if (address >= 0x4000)
+                    break;
+                if (address & 0x0100)
+                    rom_bank = (value & 0x0F) ? (value & 0x0F) : 1;
+                else
+                    ram_enabled = (value & 0x0F) == 0x0A;
+                break;
+            case MBC_3:
+                if (address < 0x2000)       ram_enabled = (value & 0x0F) == 0x0A;
+                else if (address < 0x4000)  rom_bank = (value & 0x7F) ? (value & 0x7F) : 1;
+                else if (address < 0x6000)  ram_bank = value;
+                break;
+            case MBC_5:
+                if (address < 0x2000)       ram_enabled = (value & 0x0F) == 0x0A;
+                else if (address < 0x3000)  rom_bank = (rom_bank & 0x100) | value;
+                else if (address < 0x4000)  rom_bank = (rom_bank & 0x0FF) | ((value & 0x01) << 8);
+                else if (address < 0x6000)  ram_bank = value & 0x0F;
+                break;
+            default:
+                break;
+        }
+    }
+
+    // Bank mapped at 0x0000-0x3FFF.
+    int low_rom_bank() {
+        if (type == MBC_1 && mode)
+            return (bank_upper << upper_shift()) % rom_banks;
+        return 0;
+    }
+
+    // Bank mapped at 0x4000-0x7FFF.
+    int high_rom_bank() {
+        if (type == MBC_NONE)
+            return 1;
+        if (type == MBC_1) {
+            int low = multicart ? rom_bank & 0x0F : rom_bank;
+            return ((bank_upper << upper_shift()) | low) % rom_banks;
+        }
+        return rom_bank % rom_banks;
+    }
+
+    // RTC register mapped at 0xA000-0xBFFF, -1 for none.
+    int rtc_register() {
+        if (!rtc || !ram_enabled || ram_bank < 0x08 || ram_bank > 0x0C)
+            return -1;
+        return ram_bank;
+    }
+
+    // Bank mapped at 0xA000-0xBFFF, -1 for nothing (disabled, no RAM, or an
+    // MBC3 RTC register).
+    int mapped_ram_bank() {
+        if (type == MBC_NONE)
+            return ram_banks ? 0 : -1;
+        if (!ram_enabled || (type != MBC_2 && !ram_banks))
+            return -1;
+
+        switch (type) {
+            case MBC_1: return mode ? bank_upper % ram_banks : 0;
+            case MBC_2: return 0;
+            case MBC_3: return ram_bank < 0x08 ? ram_bank % ram_banks : -1;
+            default:    return ram_bank % ram_banks;
+        }
+    }
+
+private:
+    int upper_shift() {
+        return multicart ? 4 : 5;
+    }
+};
@@ -0,0 +1,604 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "../apu/apu.h"
+#include "../cartridge/game_db.h"
+#include "../cartridge/rom_image.h"
+#include "../joypad/joypad.h"
+#include "../ppu/lcd.h"
+#include "../scheduler/scheduler.h"
+#include "../serial/serial.h"
+#include "../timer/timer.h"
+#include "mbc.h"
+#include "rtc.h"
+#include "save_ram.h"
+
+// IO registers
+#define IF      0xFF0F
+#define IE      0xFFFF
+#define LCDC    0xFF40
+#define STAT    0xFF41
+#define SCY     0xFF42
+#define SCX     0xFF43
+#define LY      0xFF44
+#define LYC     0xFF45
+#define BGP     0xFF47
+#define OBP0    0xFF48
+#define OBP1    0xFF49
+#define WY      0xFF4A
+#define WX      0xFF4B
+#define DMA     0xFF46
+
+#define DMA_LENGTH  0xA0    // bytes copied, also the M-cycles the bus is busy
+
+// Page tables
+#define PAGE_SHIFT  8
+#define PAGE_MASK   0xFF
+#define PAGE_COUNT  0x100
+
+// Interrupt bits in IE / IF
+#define INT_VBLANK  0x01
+#define INT_STAT    0x02
+#define INT_TIMER   0x04
+#define INT_SERIAL  0x08
+#define INT_JOYPAD  0x10
+
+// Receives accesses to the watched pages (Memory::watch). The address is
+// not filtered, most of the page is usually not of interest.
+class MemoryWatcher {
+public:
+    virtual ~MemoryWatcher() {}
+    virtual void watched_read(uint16_t address, uint8_t value) = 0;
+    virtual void watched_write(uint16_t address, uint8_t value) = 0;
+};
+
+class Memory {
+public:
+    uint16_t address_space = 0xFFFF;
+    uint8_t *ROM_bank_00;
+    uint8_t *ROM_bank_01_NN;
+    uint8_t VRAM[0x2000] = {};
+    uint8_t *ERAM;
+    uint8_t WRAM_1[0x1000] = {};
+    uint8_t WRAM_2[0x1000] = {};
+    uint8_t echo_RAM[0x1E00] = {};
+    uint8_t OAM[0xA0] = {};
+    uint8_t not_usable[0x5F] = {};
+    uint8_t IO[0x80] = {};
+    uint8_t HRAM[0x7F] = {};
+    uint8_t interrupt = 0;
+
+    // Cartridge. The ROM/ERAM pointers above are the page table into these,
+    // repointed by the bank controller. ROM points into the shared image,
+    // RAM is RAM_storage or, for battery backed carts, the mapped save file.
+    std::shared_ptr<const ROMImage> image;
+    const uint8_t *ROM;
+    size_t ROM_size;
+    uint8_t *RAM;
+    size_t RAM_size;
+    std::vector<uint8_t> RAM_storage;
+    SaveRAM save;
+    RTC rtc;
+    MBC mbc;
+    uint16_t ERAM_mask = 0x1FFF;
+    uint8_t open_bus = 0xFF;   // one byte page for unmapped ERAM
+
+    // Interrupt controller. pending is IE & IF while IME is set and 0
+    // otherwise, recomputed only when one of the three changes, so the run
+    // loop checks a single byte per instruction.
+    bool IME = false;
+    uint8_t pending = 0;
+
+    // Set for the 160 M-cycles of an OAM DMA, only HRAM is reachable then.
+    bool dma_active = false;
+
+    // 256 byte pages that are plain memory for the CPU. nullptr sends the
+    // access through the slow path: registers, banking side effects, the DMA
+    // lockout and watched pages.
+    uint8_t *read_pages[PAGE_COUNT] = {};
+    uint8_t *write_pages[PAGE_COUNT] = {};
+
+    MemoryWatcher *watcher = nullptr;
+    uint16_t watch_reads[PAGE_COUNT] = {};
+    uint16_t watch_writes[PAGE_COUNT] = {};
+
+    OAMLineTable oam_lines;
+    Scheduler scheduler;
+    APU apu;
+    Timer timer;
+    Serial serial;
+    Joypad joypad;
+
+    Memory() {
+        load_rom(nullptr);
+        map_pages();
+        scheduler.schedule(EVENT_FRAME, FRAME_CYCLES);
+        scheduler.schedule(EVENT_APU_FRAME, APU_FRAME_CYCLES);
+    }
+
+    ~Memory() {
+        store_rtc();
+    }
+
+    uint8_t &operator[] (uint16_t address) {
+        if (address < 0x4000) {
+            return ROM_bank_00[address];
+        } else if (address < 0x8000) {
+            return ROM_bank_01_NN[address - 0x4000];
+        } else if (address < 0xA000) {
+            return VRAM[address - 0x8000];
+        } else if (address < 0xC000) {
+            return ERAM[(address - 0xA000) & ERAM_mask];
+        } else if (address < 0xD000) {
+            return WRAM_1[address - 0xC000];            
+        } else if (address < 0xE000) {
+            return WRAM_2[address - 0xD000];
+        } else if (address < 0xFE00) {
+            return echo_RAM[address - 0xE000];
+        } else if (address < 0xFEA0) {
+            return OAM[address - 0xFE00];
+        } else if (address < 0xFF00) {
+            return not_usable[address - 0xFEA0];
+        } else if (address < 0xFF80) {
+            return IO[address - 0xFF00];
+        } else if (address < 0xFFFF) {
+            return HRAM[address - 0xFF80];
+        } else if (address == 0xFFFF) {
+            return interrupt;
+        } 
+        // return exception
+        return interrupt;
+    }
+
+    // Maps a ROM image and sets up its bank controller. The image is shared
+    // and only read, instances keep nothing of the ROM but their bank
+    // pointers. nullptr maps an empty cartridge.
+    void load_rom(std::shared_ptr<const ROMImage> _image) {
+        static const std::vector<uint8_t> blank(2 * ROM_BANK_SIZE, 0xFF);
+
+        store_rtc();
+        save.close();
+
+        image = std::move(_image);
+        ROM = image ? image->data : blank.data();
+        ROM_size = image ? image->size : blank.size();
+
+        mbc = MBC();
+        mbc.type = mbc_type(ROM[CART_TYPE_ADDRESS]);
+        mbc.rom_banks = image ? image->banks : 2;
+        mbc.ram_banks = ram_banks(ROM[RAM_SIZE_ADDRESS]);
+        mbc.rtc = has_rtc(ROM[CART_TYPE_ADDRESS]);
+        rtc.reset(scheduler.now);
+        allocate_ram();
+    }
+
+    // Database overrides for what the header gets wrong. Before load_save(),
+    // the controller decides how much RAM there is.
+    void apply_settings(const GameSettings &settings) {
+        if (settings.mbc >= 0 && settings.mbc != mbc.type) {
+            // the header's clock and RAM only held for its own controller;
+            // the ROM banks are the image's and stay
+            mbc.type = static_cast<MBCType>(settings.mbc);
+            mbc.rtc = mbc.type == MBC_3;
+            mbc.ram_banks = std::min(ram_banks(ROM[RAM_SIZE_ADDRESS]), max_ram_banks(mbc.type));
+            allocate_ram();
+        }
+        mbc.multicart = settings.quirks & QUIRK_MBC1_MULTICART;
+        remap();
+    }
+
+    // Battery backed cartridges keep their RAM in filename from now on, the
+    // clock of MBC3+TIMER carts goes in a footer after it. False (RAM stays
+    // volatile) for carts without a battery.
+    bool load_save(const char *filename) {
+        if (!has_battery(ROM[CART_TYPE_ADDRESS]) || (RAM_size == 0 && !mbc.rtc))
+            return false;
+        if (!save.open(filename, RAM_size + (mbc.rtc ? RTC_SAVE_SIZE : 0)))
+            return false;
+        RAM = save.data;
+        if (mbc.rtc) {
+            if (save.loaded == save.size)
+                rtc.load(RAM + RAM_size, scheduler.now);
+            else
+                store_rtc();
+        }
+        remap();
+        return true;
+    }
+
+    // Back to blank volatile cartridge RAM and a zeroed clock, leaving the
+    // .sav as it is. Movies start from here so they replay the same on any
+    // machine.
+    void detach_save() {
+        save.close();
+        rtc.reset(scheduler.now);
+        allocate_ram();
+    }
+
+    uint8_t read(uint16_t address) {
+        const uint8_t *page = read_pages[address >> PAGE_SHIFT];
+        if (page)
+            return page[address & PAGE_MASK];
+        return read_slow(address);
+    }
+
+    // Instruction fetch. Watchpoints are for data, so unmapped fetches skip
+    // the watcher but still go through the devices (and the DMA lockout).
+    uint8_t fetch(uint16_t address) {
+        const uint8_t *page = read_pages[address >> PAGE_SHIFT];
+        return page ? page[address & PAGE_MASK] : read_devices(address);
+    }
+
+    // CPU visible writes. Plain memory goes straight through the page table.
+    void write(uint16_t address, uint8_t value) {
+        uint8_t *page = write_pages[address >> PAGE_SHIFT];
+        if (page) {
+            page[address & PAGE_MASK] = value;
+            return;
+        }
+        if (watcher && watch_writes[address >> PAGE_SHIFT])
+            watcher->watched_write(address, value);
+        write_slow(address, value);
+    }
+
+    // Takes page out of the page tables for reads and/or writes, so every
+    // access to it reaches the watcher. Calls nest.
+    void watch(uint8_t page, bool reads, bool writes) {
+        watch_reads[page] += reads;
+        watch_writes[page] += writes;
+        map_pages();
+    }
+
+    void unwatch(uint8_t page, bool reads, bool writes) {
+        watch_reads[page] -= reads && watch_reads[page];
+        watch_writes[page] -= writes && watch_writes[page];
+        map_pages();
+    }
+
+private:
+    uint8_t read_slow(uint16_t address) {
+        uint8_t value = read_devices(address);
+        if (watcher && watch_reads[address >> PAGE_SHIFT])
+            watcher->watched_read(address, value);
+        return value;
+    }
+
+    uint8_t read_devices(uint16_t address) {
+        if (dma_active && !hram(address))
+            return 0xFF;
+        if (address >= APU_START && address < APU_END)
+            return apu.read(address, scheduler.now);
+        if (address == P1)
+            return joypad.read();
+        if (address == SB || address == SC)
+            return serial.read(address);
+        if (address >= DIV && address <= TAC) {
+            sync_timer();
+            return timer.read(address, scheduler.now);
+        }
+        return (*this)[address];
+    }
+
+    // Anything with side effects is caught here, plain memory falls through
+    // to operator[].
+    void write_slow(uint16_t address, uint8_t value) {
+        if (dma_active && !hram(address))
+            return;
+
+        if (address < 0x8000) {
+            mbc.write(address, value);
+            if (mbc.rtc && address >= 0x6000)
+                rtc.write_latch(value, scheduler.now);
+            remap();
+            return;
+        }
+
+        if (address >= 0xA000 && address < 0xC000) {
+            int reg = mbc.rtc_register();
+            if (reg >= 0) {
+                rtc.write(reg, value, scheduler.now);
+                store_rtc();
+                return;
+            }
+            if (ERAM == &open_bus)
+                return;
+            if (mbc.type == MBC_2)
+                value |= 0xF0;
+            uint16_t offset = (address - 0xA000) & ERAM_mask;
+            ERAM[offset] = value;
+            if (save.is_open())
+                save.mark(ERAM - RAM + offset);
+            return;
+        }
+
+        if (address >= 0xFE00 && address < 0xFEA0) {
+            uint8_t offset = address - 0xFE00;
+            if ((offset & 0x03) == 0)
+                oam_lines.move(offset / 4, OAM[offset], value);
+            OAM[offset] = value;
+            return;
+        }
+
+        if (address >= APU_START && address < APU_END) {
+            apu.write(address, value, scheduler.now);
+            return;
+        }
+
+        if (address == P1) {
+            joypad.write(value);
+            return;
+        }
+
+        if (address == SB || address == SC) {
+            uint64_t done = serial.write(address, value, scheduler.now);
+            if (done != NEVER)
+                scheduler.schedule(EVENT_SERIAL, done);
+            return;
+        }
+
+        if (address >= DIV && address <= TAC) {
+            sync_timer();
+            timer.write(address, value, scheduler.now);
+            schedule_timer();
+            return;
+        }
+
+        if (address == IF || address == IE) {
+            (*this)[address] = value;
+            update_pending();
+            return;
+        }
+
+        if (address == DMA) {
+            IO[DMA - 0xFF00] = value;
+            start_dma(value);
+            return;
+        }
+
+        if (address == LCDC) {
+            bool tall = value & LCDC_OBJ_SIZE;
+            if (tall != (oam_lines.height == 16))
+                oam_lines.rebuild(OAM, tall);
+        }
+
+        (*this)[address] = value;
+    }
+
+public:
+    // Headless instances turn sample generation off, the APU then only keeps
+    // its registers consistent and the per-frame flush event is dropped.
+    void set_audio(bool on) {
+        apu.set_synthesis(on, scheduler.now);
+        if (on)
+            scheduler.schedule(EVENT_APU_FRAME, scheduler.now + APU_FRAME_CYCLES);
+        else
+            scheduler.cancel(EVENT_APU_FRAME);
+    }
+
+    // Plugs in one end of a link cable. From then on this instance runs in
+    // lockstep with whatever is on the other end, so both have to be run.
+    void connect(LinkPort *port) {
+        serial.port = port;
+        port->clock.store(scheduler.now, std::memory_order_release);
+        port->horizon.store(scheduler.now + SERIAL_TRANSFER_CYCLES, std::memory_order_release);
+        scheduler.schedule(EVENT_SERIAL_SYNC, serial.next_sync(scheduler.now));
+    }
+
+    // The run loop stopped: the peer may run up to here (and a little past).
+    void pause_link() {
+        if (serial.port)
+            serial.publish_clock(scheduler.now);
+    }
+
+    // Called by the run loop once scheduler.now reaches scheduler.next.
+    void run_events() {
+        Event event;
+        while ((event = scheduler.pop_due()) != EVENT_COUNT) {
+            switch (event) {
+                case EVENT_FRAME:
+                    // stands in for the PPU entering VBlank until there is
+                    // real mode and LY timing
+                    request_interrupt(INT_VBLANK);
+                    if (joypad.next_frame())
+                        request_interrupt(INT_JOYPAD);
+                    // on a fixed grid, so frame k always starts at k * FRAME_CYCLES
+                    scheduler.schedule(EVENT_FRAME, scheduler.due + FRAME_CYCLES);
+                    break;
+                case EVENT_APU_FRAME:
+                    apu.end_frame(scheduler.now);
+                    scheduler.schedule(EVENT_APU_FRAME, scheduler.now + APU_FRAME_CYCLES);
+                    break;
+                case EVENT_DMA_END:
+                    dma_active = false;
+                    map_pages();
+                    break;
+                case EVENT_SERIAL:
+                    if (serial.complete(scheduler.now))
+                        request_interrupt(INT_SERIAL);
+                    break;
+                case EVENT_SERIAL_SYNC:
+                    if (serial.sync(scheduler.now))
+                        request_interrupt(INT_SERIAL);
+                    scheduler.schedule(EVENT_SERIAL_SYNC, serial.next_sync(scheduler.now));
+                    break;
+                case EVENT_TIMER:
+                    sync_timer();
+                    schedule_timer();
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    // Hash of the whole machine state outside the CPU, to check that
+    // replays match: memory, cartridge RAM and banking, clock, timer, APU,
+    // interrupts and every pending event.
+    uint64_t state_hash() {
+        uint64_t hash = fnv1a(VRAM, sizeof(VRAM));
+        hash = fnv1a(RAM, RAM_size, hash);
+        hash = fnv1a(WRAM_1, sizeof(WRAM_1), hash);
+        hash = fnv1a(WRAM_2, sizeof(WRAM_2), hash);
+        hash = fnv1a(OAM, sizeof(OAM), hash);
+        hash = fnv1a(IO, sizeof(IO), hash);
+        hash = fnv1a(HRAM, sizeof(HRAM), hash);
+        hash = fnv1a_value(interrupt, hash);
+        hash = fnv1a_value(IME, hash);
+        hash = fnv1a_value(dma_active, hash);
+        hash = mbc.state_hash(hash);
+        hash = rtc.state_hash(hash);
+        hash = timer.state_hash(hash);
+        hash = apu.state_hash(hash);
+        return scheduler.state_hash(hash);
+    }
+
+    void request_interrupt(uint8_t interrupt_bit) {
+        IO[IF - 0xFF00] |= interrupt_bit;
+        update_pending();
+    }
+
+    void acknowledge(uint8_t interrupt_bit) {
+        IO[IF - 0xFF00] &= ~interrupt_bit;
+        update_pending();
+    }
+
+    void set_IME(bool on) {
+        IME = on;
+        update_pending();
+    }
+
+    // Enabled and requested, regardless of IME (HALT wake up).
+    uint8_t requested() {
+        return interrupt & IO[IF - 0xFF00] & 0x1F;
+    }
+
+private:
+    void allocate_ram() {
+        if (mbc.type == MBC_2)
+            RAM_storage.assign(MBC2_RAM_SIZE, 0xFF);
+        else
+            RAM_storage.assign(mbc.ram_banks * RAM_BANK_SIZE, 0xFF);
+        RAM = RAM_storage.data();
+        RAM_size = RAM_storage.size();
+        remap();
+    }
+
+    // The ROM is mapped read-only. It is never written through these
+    // pointers: every write below 0x8000 goes to the MBC instead.
+    void remap() {
+        ROM_bank_00 = const_cast<uint8_t *>(&ROM[mbc.low_rom_bank() * ROM_BANK_SIZE]);
+        ROM_bank_01_NN = const_cast<uint8_t *>(&ROM[mbc.high_rom_bank() * ROM_BANK_SIZE]);
+
+        int bank = mbc.mapped_ram_bank();
+        int reg = mbc.rtc_register();
+        if (reg >= 0) {
+            // a single byte "page": every address reads the latched register
+            ERAM = &rtc.latched[reg - RTC_S];
+            ERAM_mask = 0;
+        } else if (bank < 0) {
+            ERAM = &open_bus;
+            ERAM_mask = 0;
+        } else {
+            ERAM = &RAM[bank * RAM_BANK_SIZE];
+            ERAM_mask = mbc.type == MBC_2 ? MBC2_RAM_SIZE - 1 : 0x1FFF;
+        }
+        map_cartridge_pages();
+    }
+
+    // Only the cartridge pages change on a bank switch.
+    void map_cartridge_pages() {
+        if (dma_active)
+            return;
+
+        for (int p = 0x00; p < 0x80; p++) {
+            uint8_t *bank = p < 0x40 ? ROM_bank_00 : ROM_bank_01_NN;
+            read_pages[p] = watch_reads[p] ? nullptr : bank + ((p << PAGE_SHIFT) & 0x3FFF);
+        }
+
+        // RTC registers and open bus are single byte pages; MBC2 nibbles,
+        // RTC writes and dirty save pages need the slow write path
+        bool contiguous = ERAM_mask > PAGE_MASK;
+        bool plain_writes = contiguous && mbc.type != MBC_2 && !save.is_open();
+        for (int p = 0xA0; p < 0xC0; p++) {
+            uint8_t *page = contiguous ? ERAM + ((p << PAGE_SHIFT) & ERAM_mask) : nullptr;
+            read_pages[p] = watch_reads[p] ? nullptr : page;
+            write_pages[p] = watch_writes[p] || !plain_writes ? nullptr : page;
+        }
+    }
+
+    // Rebuilds both page tables. Everything is unmapped during OAM DMA.
+    void map_pages() {
+        for (int p = 0; p < PAGE_COUNT; p++) {
+            read_pages[p] = nullptr;
+            write_pages[p] = nullptr;
+        }
+        if (dma_active)
+            return;
+
+        map_cartridge_pages();
+
+        // VRAM, WRAM and echo RAM; OAM/unusable (0xFE) and IO/HRAM (0xFF)
+        // always take the slow path
+        for (int p = 0x80; p < 0xFE; p++) {
+            if (p >= 0xA0 && p < 0xC0)
+                continue;
+            uint8_t *page = &(*this)[p << PAGE_SHIFT];
+            read_pages[p] = watch_reads[p] ? nullptr : page;
+            write_pages[p] = watch_writes[p] ? nullptr : page;
+        }
+    }
+
+    // Keeps the clock footer of the save file current. Only needed when the
+    // clock is set and when the save is closed, the value is lazy anyway.
+    void store_rtc() {
+        if (!mbc.rtc || !save.is_open())
+            return;
+        rtc.save(RAM + RAM_size, scheduler.now);
+        save.mark(RAM_size);
+        save.mark(RAM_size + RTC_SAVE_SIZE - 1);
+    }
+
+    bool hram(uint16_t address) {
+        return address >= 0xFF80 && address < 0xFFFF;
+    }
+
+    // The whole transfer happens up front, the scheduler only ends the
+    // window in which the CPU is locked out of the bus.
+    void start_dma(uint8_t page) {
+        uint16_t source = page << 8;
+        // cartridge RAM can be a single byte (disabled, an RTC register)
+        bool contiguous = source < 0xA000 || (source >= 0xC000 && source < 0xE000) ||
+                          (source < 0xC000 && ERAM_mask > PAGE_MASK);
+        if (contiguous) {
+            memcpy(OAM, &(*this)[source], DMA_LENGTH);
+        } else {
+            for (int i = 0; i < DMA_LENGTH; i++)
+                OAM[i] = (*this)[source + i];
+        }
+
+        oam_lines.rebuild(OAM, oam_lines.height == 16);
+        dma_active = true;
+        map_pages();
+        scheduler.schedule(EVENT_DMA_END, scheduler.now + DMA_LENGTH);
+    }
+
+    void update_pending() {
+        pending = IME ? requested() : 0;
+    }
+
+    void sync_timer() {
+        if (timer.sync(scheduler.now))
+            request_interrupt(INT_TIMER);
+    }
+
+    void schedule_timer() {
+        uint64_t at = timer.next_overflow();
+        if (at == NEVER)
+            scheduler.cancel(EVENT_TIMER);
+        else
+            scheduler.schedule(EVENT_TIMER, at);
+    }
+};
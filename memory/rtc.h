@@ -0,0 +1,174 @@
+#pragma once
+
+#include <cstdint>
+#include <ctime>
+
+#include "../util/fnv1a.h"
+
+// MBC3 clock registers, selected by writing 0x08-0x0C to 0x4000-0x5FFF
+#define RTC_S       0x08
+#define RTC_M       0x09
+#define RTC_H       0x0A
+#define RTC_DL      0x0B
+#define RTC_DH      0x0C
+
+// RTC_DH bits
+#define RTC_DAY_HIGH    0x01
+#define RTC_HALT        0x40
+#define RTC_CARRY       0x80
+
+#define RTC_CYCLES_PER_SECOND   1048576     // M-cycles
+#define RTC_DAY_SECONDS         86400
+#define RTC_WRAP_SECONDS        (512 * RTC_DAY_SECONDS)
+#define RTC_SAVE_SIZE           48          // BGB/VBA .sav footer
+
+enum RTCSource {
+    RTC_EMULATED,   // runs with scheduler time, fast-forwarding speeds it up
+    RTC_HOST        // wall clock
+};
+
+// Nothing ticks: the clock is a value at a base time, and the registers
+// are only worked out from it when the game latches or writes them.
+class RTC {
+public:
+    RTCSource source = RTC_EMULATED;
+    uint8_t latched[5] = {0};   // what 0xA000-0xBFFF reads, S M H DL DH
+
+    void reset(uint64_t now) {
+        base_seconds = 0;
+        halted = false;
+        carry = false;
+        latch_state = 0xFF;
+        rebase(now);
+        latch(now);
+    }
+
+    // Switching keeps the current clock value.
+    void set_source(RTCSource _source, uint64_t now) {
+        base_seconds = seconds(now);
+        source = _source;
+        rebase(now);
+    }
+
+    // A write to 0x6000-0x7FFF. 0x00 then 0x01 latches.
+    void write_latch(uint8_t value, uint64_t now) {
+        if (latch_state == 0x00 && value == 0x01)
+            latch(now);
+        latch_state = value;
+    }
+
+    void latch(uint64_t now) {
+        fill(latched, seconds(now));
+    }
+
+    // Sets one register. The sub-second counter restarts, as on hardware.
+    void write(int reg, uint8_t value, uint64_t now) {
+        int64_t t = seconds(now);
+        int64_t s = t % 60, m = (t / 60) % 60, h = (t / 3600) % 24, d = t / RTC_DAY_SECONDS;
+
+        switch (reg) {
+            case RTC_S:  s = value & 0x3F; break;
+            case RTC_M:  m = value & 0x3F; break;
+            case RTC_H:  h = value & 0x1F; break;
+            case RTC_DL: d = (d & 0x100) | value; break;
+            case RTC_DH:
+                d = (d & 0xFF) | ((value & RTC_DAY_HIGH) << 8);
+                halted = value & RTC_HALT;
+                carry = value & RTC_CARRY;
+                break;
+        }
+
+        base_seconds = s + m * 60 + h * 3600 + d * RTC_DAY_SECONDS;
+        rebase(now);
+        latched[reg - RTC_S] = value;
+    }
+
+    // Footer of the .sav: live registers, latched registers (5 x u32 each)
+    // and the host time they were written at (u64).
+    void save(uint8_t *footer, uint64_t now) {
+        uint8_t live[5];
+        fill(live, seconds(now));
+        for (int i = 0; i < 5; i++) {
+            put32(footer + i * 4, live[i]);
+            put32(footer + 20 + i * 4, latched[i]);
+        }
+        uint64_t timestamp = time(nullptr);
+        for (int i = 0; i < 8; i++)
+            footer[40 + i] = timestamp >> (i * 8);
+    }
+
+    // On the wall clock the time the file was closed counts too, emulated
+    // time carries on from where it stopped.
+    void load(const uint8_t *footer, uint64_t now) {
+        uint8_t live[5];
+        for (int i = 0; i < 5; i++) {
+            live[i] = footer[i * 4];
+            latched[i] = footer[20 + i * 4];
+        }
+        uint64_t timestamp = 0;
+        for (int i = 0; i < 8; i++)
+            timestamp |= (uint64_t)footer[40 + i] << (i * 8);
+
+        halted = live[4] & RTC_HALT;
+        carry = live[4] & RTC_CARRY;
+        base_seconds = live[0] % 60 + (live[1] % 60) * 60 + (live[2] % 24) * 3600
+                     + (live[3] | ((live[4] & RTC_DAY_HIGH) << 8)) * (int64_t)RTC_DAY_SECONDS;
+        if (source == RTC_HOST && !halted && (uint64_t)time(nullptr) > timestamp)
+            base_seconds += time(nullptr) - timestamp;
+        latch_state = 0xFF;
+        rebase(now);
+    }
+
+    uint64_t state_hash(uint64_t hash) const {
+        hash = fnv1a(latched, sizeof(latched), hash);
+        hash = fnv1a_value(base_seconds, hash);
+        hash = fnv1a_value(base_cycles, hash);
+        hash = fnv1a_value(halted, hash);
+        hash = fnv1a_value(carry, hash);
+        return fnv1a_value(latch_state, hash);
+    }
+
+private:
+    int64_t base_seconds = 0;   // clock value at the base time
+    uint64_t base_cycles = 0;
+    int64_t base_host = 0;
+    bool halted = false;
+    bool carry = false;
+    uint8_t latch_state = 0xFF;
+
+    void rebase(uint64_t now) {
+        base_cycles = now;
+        base_host = time(nullptr);
+    }
+
+    // Seconds since day 0, wrapped at 512 days (which sets the carry).
+    int64_t seconds(uint64_t now) {
+        if (halted)
+            return base_seconds;
+
+        int64_t elapsed = source == RTC_EMULATED
+            ? (now - base_cycles) / RTC_CYCLES_PER_SECOND
+            : time(nullptr) - base_host;
+        int64_t t = base_seconds + elapsed;
+        if (t >= RTC_WRAP_SECONDS) {
+            carry = true;
+            base_seconds -= (t / RTC_WRAP_SECONDS) * RTC_WRAP_SECONDS;
+            t %= RTC_WRAP_SECONDS;
+        }
+        return t;
+    }
+
+    void fill(uint8_t *registers, int64_t t) {
+        int64_t days = t / RTC_DAY_SECONDS;
+        registers[0] = t % 60;
+        registers[1] = (t / 60) % 60;
+        registers[2] = (t / 3600) % 24;
+        registers[3] = days & 0xFF;
+        registers[4] = ((days >> 8) & RTC_DAY_HIGH) | (halted ? RTC_HALT : 0) | (carry ? RTC_CARRY : 0);
+    }
+
+    static void put32(uint8_t *out, uint32_t value) {
+        for (int i = 0; i < 4; i++)
+            out[i] = value >> (i * 8);
+    }
+};
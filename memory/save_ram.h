@@ -0,0 +1,216 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../cartridge/cartridge_maps.h"
+
+#define SAVE_PAGE_SIZE          0x1000
+#define SAVE_PAGE_SHIFT         12
+#define SAVE_MAX_PAGES          64      // 256 KiB, more than any MBC maps
+#define SAVE_FLUSH_INTERVAL     1000    // ms
+
+// Cartridge types whose name in cartridge_type_map ends in "+BATTERY".
+inline bool has_battery(uint8_t cartridge_type) {
+    static const std::string_view suffix = "+BATTERY";
+    std::string_view name = cartridge_type_map[cartridge_type];
+    return name.size() >= suffix.size() && name.substr(name.size() - suffix.size()) == suffix;
+}
+
+// Cartridge RAM backed by a shared mapping of the .sav file. The emulation
+// thread writes straight into the mapping and only sets a bit per dirty 4
+// KiB page; the SaveFlusher thread msyncs those pages later.
+class SaveRAM {
+public:
+    uint8_t *data = nullptr;
+    size_t size = 0;
+    size_t loaded = 0;      // bytes that came from an existing file
+
+    SaveRAM() {}
+
+    SaveRAM(const SaveRAM &) = delete;
+    SaveRAM &operator=(const SaveRAM &) = delete;
+
+    ~SaveRAM() {
+        close();
+    }
+
+    // Maps filename, creating it (filled with 0xFF, like fresh cartridge
+    // RAM) or growing it to _size bytes.
+    bool open(const char *filename, size_t _size) {
+        close();
+        if (_size == 0 || _size > SAVE_MAX_PAGES * SAVE_PAGE_SIZE)
+            return false;
+
+        int fd = ::open(filename, O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            std::cout << "Failed to open " << filename << "\n";
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) < 0 || ((size_t)st.st_size < _size && ftruncate(fd, _size) < 0)) {
+            std::cout << "Failed to size " << filename << "\n";
+            ::close(fd);
+            return false;
+        }
+
+        void *mapping = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (mapping == MAP_FAILED) {
+            std::cout << "Failed to map " << filename << "\n";
+            return false;
+        }
+
+        data = static_cast<uint8_t *>(mapping);
+        size = _size;
+        loaded = std::min((size_t)st.st_size, size);
+
+        if ((size_t)st.st_size < size) {
+            memset(data + st.st_size, 0xFF, size - st.st_size);
+            dirty = page_mask(st.st_size, size);
+        }
+        attach();
+        return true;
+    }
+
+    // Writes back whatever is still dirty and unmaps.
+    void close() {
+        if (!data)
+            return;
+        detach();
+        flush();
+        munmap(data, size);
+        data = nullptr;
+        size = 0;
+        loaded = 0;
+    }
+
+    bool is_open() const {
+        return data != nullptr;
+    }
+
+    // Emulation thread, after every write. Usually just a relaxed load.
+    void mark(size_t offset) {
+        uint64_t bit = 1ull << (offset >> SAVE_PAGE_SHIFT);
+        if (!(dirty.load(std::memory_order_relaxed) & bit))
+            dirty.fetch_or(bit, std::memory_order_relaxed);
+    }
+
+    // Flusher thread (or close). msyncs each run of dirty pages once.
+    void flush() {
+        uint64_t pages = dirty.exchange(0, std::memory_order_acquire);
+        while (pages) {
+            int first = __builtin_ctzll(pages);
+            int last = first;
+            while (last + 1 < SAVE_MAX_PAGES && (pages >> (last + 1)) & 1)
+                last++;
+
+            size_t start = (size_t)first << SAVE_PAGE_SHIFT;
+            size_t end = std::min(size, (size_t)(last + 1) << SAVE_PAGE_SHIFT);
+            msync(data + start, end - start, MS_SYNC);
+
+            pages &= last + 1 < 64 ? ~0ull << (last + 1) : 0;
+        }
+    }
+
+private:
+    std::atomic<uint64_t> dirty{0};
+
+    void attach();
+    void detach();
+
+    static uint64_t page_mask(size_t from, size_t to) {
+        uint64_t mask = 0;
+        for (size_t page = from >> SAVE_PAGE_SHIFT; page << SAVE_PAGE_SHIFT < to; page++)
+            mask |= 1ull << page;
+        return mask;
+    }
+};
+
+// One background thread flushing every open save in the process, so
+// thousands of instances cost one thread and one wakeup per interval.
+class SaveFlusher {
+public:
+    static SaveFlusher &instance() {
+        static SaveFlusher flusher;
+        return flusher;
+    }
+
+    void add(SaveRAM *save) {
+        std::lock_guard<std::mutex> lock(mutex);
+        saves.push_back(save);
+        if (!worker.joinable())
+            worker = std::thread(&SaveFlusher::run, this);
+    }
+
+    // Must be called before the SaveRAM is closed.
+    void remove(SaveRAM *save) {
+        std::lock_guard<std::mutex> lock(mutex);
+        saves.erase(std::remove(saves.begin(), saves.end(), save), saves.end());
+    }
+
+    void set_interval(int milliseconds) {
+        std::lock_guard<std::mutex> lock(mutex);
+        interval = std::chrono::milliseconds(milliseconds);
+        wake.notify_one();
+    }
+
+    // Flushes everything now, e.g. before the process exits.
+    void flush_all() {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (SaveRAM *save : saves)
+            save->flush();
+    }
+
+    ~SaveFlusher() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            wake.notify_one();
+        }
+        if (worker.joinable())
+            worker.join();
+        flush_all();
+    }
+
+private:
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::vector<SaveRAM *> saves;
+    std::thread worker;
+    std::chrono::milliseconds interval{SAVE_FLUSH_INTERVAL};
+    bool stopping = false;
+
+    SaveFlusher() {}
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping) {
+            wake.wait_for(lock, interval);
+            for (SaveRAM *save : saves)
+                save->flush();
+        }
+    }
+};
+
+inline void SaveRAM::attach() {
+    SaveFlusher::instance().add(this);
+}
+
+inline void SaveRAM::detach() {
+    SaveFlusher::instance().remove(this);
+}
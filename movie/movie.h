@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "../util/fnv1a.h"
+
+#define MOVIE_MAGIC     "GBMV"
+#define MOVIE_VERSION   1
+
+// Where playback starts from. Only power-on exists until there are save
+// states to embed; it means blank cartridge RAM and a zeroed clock, never
+// the contents of a .sav.
+#define MOVIE_POWER_ON  0
+
+struct MovieHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t rom_hash;
+    uint32_t start;
+    uint32_t frame_count;
+};
+
+// One joypad bitmask per frame (see joypad.h for the bit layout).
+class Movie {
+public:
+    MovieHeader header;
+    std::vector<uint8_t> frames;
+
+    Movie(uint64_t rom_hash = 0) {
+        memcpy(header.magic, MOVIE_MAGIC, 4);
+        header.version = MOVIE_VERSION;
+        header.rom_hash = rom_hash;
+        header.start = MOVIE_POWER_ON;
+        header.frame_count = 0;
+    }
+
+    bool save(const char *filename) {
+        FILE *fp = fopen(filename, "wb");
+        if (!fp)
+            return false;
+
+        header.frame_count = frames.size();
+        bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+               && fwrite(frames.data(), 1, frames.size(), fp) == frames.size();
+        fclose(fp);
+        return ok;
+    }
+
+    bool load(const char *filename) {
+        FILE *fp = fopen(filename, "rb");
+        if (!fp)
+            return false;
+
+        bool ok = fread(&header, sizeof(header), 1, fp) == 1
+               && memcmp(header.magic, MOVIE_MAGIC, 4) == 0
+               && header.version == MOVIE_VERSION;
+        if (ok) {
+            frames.resize(header.frame_count);
+            ok = fread(frames.data(), 1, frames.size(), fp) == frames.size();
+        }
+        fclose(fp);
+        return ok;
+    }
+};
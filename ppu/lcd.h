@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+
+#define SCREEN_WIDTH    160
+#define SCREEN_HEIGHT   144
+
+// LCDC bits
+#define LCDC_BG_ENABLE      0x01
+#define LCDC_OBJ_ENABLE     0x02
+#define LCDC_OBJ_SIZE       0x04
+#define LCDC_BG_MAP         0x08
+#define LCDC_TILE_DATA      0x10
+#define LCDC_WIN_ENABLE     0x20
+#define LCDC_WIN_MAP        0x40
+#define LCDC_LCD_ENABLE     0x80
+
+// OAM attribute bits
+#define OBJ_PALETTE     0x10
+#define OBJ_X_FLIP      0x20
+#define OBJ_Y_FLIP      0x40
+#define OBJ_BEHIND_BG   0x80
+
+#define OAM_ENTRIES         40
+#define SPRITES_PER_LINE    10
+
+// For every visible line, a bitmask of the OAM entries whose Y range covers
+// it. Kept in sync on OAM Y writes and sprite height changes, so per line
+// sprite selection never has to scan OAM.
+struct OAMLineTable {
+    uint64_t line_mask[SCREEN_HEIGHT] = {};
+    uint8_t height = 8;
+
+    // Sprite i moved from old_y to new_y (raw OAM Y bytes).
+    void move(int i, uint8_t old_y, uint8_t new_y) {
+        if (old_y == new_y)
+            return;
+        update(i, old_y, false);
+        update(i, new_y, true);
+    }
+
+    void rebuild(const uint8_t *OAM, bool tall) {
+        height = tall ? 16 : 8;
+        for (int line = 0; line < SCREEN_HEIGHT; line++)
+            line_mask[line] = 0;
+        for (int i = 0; i < OAM_ENTRIES; i++)
+            update(i, OAM[i * 4], true);
+    }
+
+    // Writes up to 10 OAM indices covering line, in OAM order.
+    int select(uint8_t line, uint8_t *sprites) const {
+        uint64_t mask = line_mask[line];
+        int count = 0;
+
+        while (mask && count < SPRITES_PER_LINE) {
+            sprites[count++] = __builtin_ctzll(mask);
+            mask &= mask - 1;
+        }
+        return count;
+    }
+
+private:
+    void update(int i, uint8_t y, bool set) {
+        int top = y - 16;
+        int bottom = top + height;
+        if (top < 0)
+            top = 0;
+        if (bottom > SCREEN_HEIGHT)
+            bottom = SCREEN_HEIGHT;
+
+        uint64_t bit = 1ULL << i;
+        for (int line = top; line < bottom; line++) {
+            if (set)
+                line_mask[line] |= bit;
+            else
+                line_mask[line] &= ~bit;
+        }
+    }
+};
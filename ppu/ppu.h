@@ -0,0 +1,253 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../memory/memory.h"
+#include "lcd.h"
+
+enum ObservationMode {
+    OBS_GRAYSCALE,  // 0 (black) .. 255 (white)
+    OBS_PALETTE     // shade index 0..3 after BGP/OBP mapping
+};
+
+// Maps every pixel of a downsampled observation back to the one source
+// pixel it samples, so the PPU can render straight at the target size.
+struct ObservationLayout {
+    int width;
+    int height;
+    ObservationMode mode;
+    uint8_t src_x[SCREEN_WIDTH];
+    uint8_t src_y[SCREEN_HEIGHT];
+
+    ObservationLayout(int _width, int _height, ObservationMode _mode)
+        : width(_width), height(_height), mode(_mode) {
+        if (width > SCREEN_WIDTH)   width = SCREEN_WIDTH;
+        if (height > SCREEN_HEIGHT) height = SCREEN_HEIGHT;
+        if (width < 1)              width = 1;
+        if (height < 1)             height = 1;
+
+        // sample the centre of each destination cell
+        for (int x = 0; x < width; x++)
+            src_x[x] = ((2 * x + 1) * SCREEN_WIDTH) / (2 * width);
+        for (int y = 0; y < height; y++)
+            src_y[y] = ((2 * y + 1) * SCREEN_HEIGHT) / (2 * height);
+    }
+
+    int size() const {
+        return width * height;
+    }
+};
+
+#define TILE_COLUMNS    (SCREEN_WIDTH / 8)
+#define TILE_ROWS       (SCREEN_HEIGHT / 8)
+#define TILE_NONE       0xFFFF      // nothing drawn: LCD or BG/window off
+
+struct SpriteObservation {
+    int16_t x;          // screen position of the top left pixel
+    int16_t y;
+    uint8_t tile;
+    uint8_t flags;      // raw OAM attributes
+};
+
+// What is on screen, without rendering it. Tiles are VRAM tile numbers
+// (0..383) so the same graphics get the same id whichever LCDC.4 addressing
+// mode the game uses.
+struct TileObservation {
+    uint16_t tiles[TILE_ROWS][TILE_COLUMNS];
+    int sprite_count;
+    SpriteObservation sprites[OAM_ENTRIES];
+};
+
+class PPU {
+public:
+    Memory *memory;
+
+    PPU(Memory *_memory) : memory(_memory) {}
+
+    // Renders the current VRAM/OAM state into out (layout.width * layout.height
+    // bytes). Only the sampled source pixels are ever computed.
+    void render_observation(uint8_t *out, const ObservationLayout &layout) {
+        static const uint8_t grayscale[4] = {0xFF, 0xAA, 0x55, 0x00};
+        uint8_t lcdc = io(LCDC);
+
+        if (!(lcdc & LCDC_LCD_ENABLE)) {
+            uint8_t blank = layout.mode == OBS_GRAYSCALE ? grayscale[0] : 0;
+            for (int i = 0; i < layout.size(); i++)
+                out[i] = blank;
+            return;
+        }
+
+        for (int y = 0; y < layout.height; y++) {
+            uint8_t line = layout.src_y[y];
+            uint8_t *row = out + y * layout.width;
+
+            uint8_t sprites[SPRITES_PER_LINE];
+            int sprite_count = (lcdc & LCDC_OBJ_ENABLE) ? line_sprites(line, sprites) : 0;
+
+            for (int x = 0; x < layout.width; x++) {
+                uint8_t shade = pixel_shade(lcdc, layout.src_x[x], line, sprites, sprite_count);
+                row[x] = layout.mode == OBS_GRAYSCALE ? grayscale[shade] : shade;
+            }
+        }
+    }
+
+    // Full resolution palette-index frame (SCREEN_WIDTH * SCREEN_HEIGHT bytes).
+    void render_frame(uint8_t *out) {
+        static const ObservationLayout full(SCREEN_WIDTH, SCREEN_HEIGHT, OBS_PALETTE);
+        render_observation(out, full);
+    }
+
+    // Fills obs with the 20x18 BG/window tile grid as seen through SCX/SCY
+    // and the list of on-screen sprites. Like the renderer, shows nothing
+    // with the LCD off and no tiles with LCDC.0 (BG/window) clear.
+    void observe_tiles(TileObservation &obs) {
+        uint8_t lcdc = io(LCDC);
+        bool lcd_on = lcdc & LCDC_LCD_ENABLE;
+        bool background = lcd_on && (lcdc & LCDC_BG_ENABLE);
+        bool unsigned_data = lcdc & LCDC_TILE_DATA;
+        uint16_t bg_map = (lcdc & LCDC_BG_MAP) ? 0x1C00 : 0x1800;
+        uint16_t win_map = (lcdc & LCDC_WIN_MAP) ? 0x1C00 : 0x1800;
+        bool window = (lcdc & LCDC_WIN_ENABLE) && (lcdc & LCDC_BG_ENABLE);
+        int wx = io(WX) - 7;
+        int wy = io(WY);
+
+        for (int row = 0; row < TILE_ROWS; row++) {
+            for (int col = 0; col < TILE_COLUMNS; col++) {
+                if (!background) {
+                    obs.tiles[row][col] = TILE_NONE;
+                    continue;
+                }
+                int x = col * 8;
+                int y = row * 8;
+                uint8_t tile;
+
+                if (window && x >= wx && y >= wy) {
+                    tile = memory->VRAM[win_map + ((y - wy) / 8) * 32 + (x - wx) / 8];
+                } else {
+                    uint8_t sx = x + io(SCX);
+                    uint8_t sy = y + io(SCY);
+                    tile = memory->VRAM[bg_map + (sy / 8) * 32 + sx / 8];
+                }
+
+                obs.tiles[row][col] = unsigned_data ? tile : 256 + static_cast<int8_t>(tile);
+            }
+        }
+
+        obs.sprite_count = 0;
+        if (!lcd_on || !(lcdc & LCDC_OBJ_ENABLE))
+            return;
+
+        int height = sprite_height();
+        for (int i = 0; i < OAM_ENTRIES; i++) {
+            uint8_t *obj = &memory->OAM[i * 4];
+            int x = obj[1] - 8;
+            int y = obj[0] - 16;
+            if (x <= -8 || x >= SCREEN_WIDTH || y <= -height || y >= SCREEN_HEIGHT)
+                continue;
+
+            SpriteObservation &sprite = obs.sprites[obs.sprite_count++];
+            sprite.x = x;
+            sprite.y = y;
+            sprite.tile = obj[2];
+            sprite.flags = obj[3];
+        }
+    }
+
+private:
+    uint8_t io(uint16_t address) {
+        return memory->IO[address - 0xFF00];
+    }
+
+    uint8_t sprite_height() {
+        return (io(LCDC) & LCDC_OBJ_SIZE) ? 16 : 8;
+    }
+
+    // Collects up to 10 OAM indices covering line, ordered by DMG drawing
+    // priority (lower X first, then lower OAM index).
+    int line_sprites(uint8_t line, uint8_t *sprites) {
+        int count = memory->oam_lines.select(line, sprites);
+        sort_sprites(sprites, count);
+        return count;
+    }
+
+    void sort_sprites(uint8_t *sprites, int count) {
+        for (int i = 1; i < count; i++) {
+            uint8_t sprite = sprites[i];
+            int j = i - 1;
+            while (j >= 0 && memory->OAM[sprites[j] * 4 + 1] > memory->OAM[sprite * 4 + 1]) {
+                sprites[j + 1] = sprites[j];
+                j--;
+            }
+            sprites[j + 1] = sprite;
+        }
+    }
+
+    // 2 bit colour of a tile pixel. Tiles addressed with the 0x8800 method
+    // use a signed index relative to 0x9000.
+    uint8_t tile_color(uint8_t tile, bool unsigned_data, uint8_t fine_x, uint8_t fine_y) {
+        uint16_t address = unsigned_data ? tile * 16 : 0x1000 + static_cast<int8_t>(tile) * 16;
+        address += fine_y * 2;
+        uint8_t bit = 7 - fine_x;
+        uint8_t lo = (memory->VRAM[address] >> bit) & 0x01;
+        uint8_t hi = (memory->VRAM[address + 1] >> bit) & 0x01;
+        return (hi << 1) | lo;
+    }
+
+    uint8_t background_color(uint8_t lcdc, uint8_t x, uint8_t line) {
+        if (!(lcdc & LCDC_BG_ENABLE))
+            return 0;
+
+        bool unsigned_data = lcdc & LCDC_TILE_DATA;
+        int wx = io(WX) - 7;
+
+        if ((lcdc & LCDC_WIN_ENABLE) && line >= io(WY) && x >= wx) {
+            uint16_t map = (lcdc & LCDC_WIN_MAP) ? 0x1C00 : 0x1800;
+            uint8_t wy = line - io(WY);
+            uint8_t wxx = x - wx;
+            uint8_t tile = memory->VRAM[map + (wy / 8) * 32 + wxx / 8];
+            return tile_color(tile, unsigned_data, wxx % 8, wy % 8);
+        }
+
+        uint16_t map = (lcdc & LCDC_BG_MAP) ? 0x1C00 : 0x1800;
+        uint8_t sx = x + io(SCX);
+        uint8_t sy = line + io(SCY);
+        uint8_t tile = memory->VRAM[map + (sy / 8) * 32 + sx / 8];
+        return tile_color(tile, unsigned_data, sx % 8, sy % 8);
+    }
+
+    uint8_t pixel_shade(uint8_t lcdc, uint8_t x, uint8_t line, uint8_t *sprites, int sprite_count) {
+        uint8_t bg = background_color(lcdc, x, line);
+
+        for (int i = 0; i < sprite_count; i++) {
+            uint8_t *obj = &memory->OAM[sprites[i] * 4];
+            int left = obj[1] - 8;
+            if (x < left || x >= left + 8)
+                continue;
+
+            uint8_t height = sprite_height();
+            uint8_t fine_y = line - (obj[0] - 16);
+            uint8_t fine_x = x - left;
+            if (obj[3] & OBJ_Y_FLIP) fine_y = height - 1 - fine_y;
+            if (obj[3] & OBJ_X_FLIP) fine_x = 7 - fine_x;
+
+            uint8_t tile = height == 16 ? (obj[2] & 0xFE) : obj[2];
+            uint8_t color = tile_color(tile, true, fine_x, fine_y);
+            if (color == 0)
+                continue;
+            if ((obj[3] & OBJ_BEHIND_BG) && bg != 0)
+                break;
+
+            uint8_t palette = io((obj[3] & OBJ_PALETTE) ? OBP1 : OBP0);
+            return (palette >> (color * 2)) & 0x03;
+        }
+
+        return (io(BGP) >> (bg * 2)) & 0x03;
+    }
+};
+
+// Writes one observation per instance into a single contiguous
+// [count][height][width] uint8 tensor supplied by the caller.
+inline void render_observations(PPU **instances, int count, uint8_t *tensor, const ObservationLayout &layout) {
+    for (int i = 0; i < count; i++)
+        instances[i]->render_observation(tensor + i * layout.size(), layout);
+}
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "../apu/apu.h"
+#include "../ppu/ppu.h"
+#include "../util/spsc_queue.h"
+
+#define FRAME_SIZE          (SCREEN_WIDTH * SCREEN_HEIGHT)
+#define FRAME_QUEUE_SIZE    64
+#define AUDIO_QUEUE_SIZE    (1 << 16)   // stereo sample frames
+
+// DMG refresh rate is 4194304 / 70224 Hz
+#define FPS_NUM     4194304
+#define FPS_DEN     70224
+
+// Raw container
+#define RAW_MAGIC       "GBRC"
+#define RAW_VERSION     2
+#define RAW_KEYFRAME    'K'
+#define RAW_DELTA       'D'
+#define RAW_AUDIO       'A'
+
+enum RecorderFormat {
+    REC_Y4M_WAV,    // <name>.y4m + <name>.wav
+    REC_RAW         // <name>.gbrc, delta frames with periodic keyframes
+};
+
+enum RecorderPolicy {
+    REC_DROP,           // full queue: discard the new data and count it
+    REC_BACKPRESSURE    // full queue: refuse it, the caller decides when to retry
+};
+
+struct VideoFrame {
+    uint64_t number;                // counts dropped frames too, so gaps show drops
+    uint8_t pixels[FRAME_SIZE];     // shade index 0..3
+};
+
+// Records frames and audio without ever blocking the emulation thread. The
+// emulation thread is the only producer, a background thread encodes and
+// writes to disk.
+class Recorder {
+public:
+    RecorderFormat format;
+    RecorderPolicy policy;
+    int keyframe_interval;      // 0: only the first frame is a keyframe
+    int sample_rate;
+
+    std::atomic<uint64_t> dropped_frames{0};
+    std::atomic<uint64_t> dropped_samples{0};
+
+    Recorder(const char *_basename, RecorderFormat _format, RecorderPolicy _policy,
+             int _sample_rate = 48000, int _keyframe_interval = 60)
+        : format(_format), policy(_policy), keyframe_interval(_keyframe_interval),
+          sample_rate(_sample_rate), basename(_basename),
+          frames(FRAME_QUEUE_SIZE), audio(AUDIO_QUEUE_SIZE) {}
+
+    ~Recorder() {
+        stop();
+    }
+
+    bool start() {
+        if (running)
+            return true;
+        if (!open_files())
+            return false;
+
+        running = true;
+        writer = std::thread(&Recorder::write_loop, this);
+        return true;
+    }
+
+    // Flushes everything still queued, then closes the files.
+    void stop() {
+        if (!running)
+            return;
+        running = false;
+        writer.join();
+        close_files();
+    }
+
+    // Renders the PPU straight into a queue slot, no intermediate copy.
+    bool submit_frame(PPU &ppu) {
+        VideoFrame *slot = frames.reserve();
+        if (!slot)
+            return refuse_frame();
+        slot->number = frame_count++;
+        ppu.render_frame(slot->pixels);
+        frames.commit();
+        return true;
+    }
+
+    bool submit_frame(const uint8_t *pixels) {
+        VideoFrame *slot = frames.reserve();
+        if (!slot)
+            return refuse_frame();
+        slot->number = frame_count++;
+        memcpy(slot->pixels, pixels, FRAME_SIZE);
+        frames.commit();
+        return true;
+    }
+
+    // Returns how many sample frames were accepted.
+    size_t submit_audio(const StereoSample *samples, size_t count) {
+        size_t queued = audio.push(samples, count);
+        if (queued < count && policy == REC_DROP)
+            dropped_samples += count - queued;
+        return queued;
+    }
+
+    // For REC_BACKPRESSURE: true while the writer is behind.
+    bool congested() const {
+        return frames.size() >= FRAME_QUEUE_SIZE / 2;
+    }
+
+private:
+    std::string basename;
+    SPSCQueue<VideoFrame> frames;
+    SPSCQueue<StereoSample> audio;
+    std::thread writer;
+    std::atomic<bool> running{false};
+    uint64_t frame_count = 0;
+
+    FILE *video_file = nullptr;
+    FILE *audio_file = nullptr;
+    uint32_t audio_bytes = 0;
+
+    // writer thread state
+    uint8_t previous[FRAME_SIZE];
+    uint64_t frames_written = 0;
+
+    bool refuse_frame() {
+        if (policy == REC_DROP) {
+            dropped_frames++;
+            frame_count++;
+        }
+        return false;
+    }
+
+    bool open_files() {
+        if (format == REC_Y4M_WAV) {
+            video_file = fopen((basename + ".y4m").c_str(), "wb");
+            audio_file = fopen((basename + ".wav").c_str(), "wb");
+            if (!video_file || !audio_file) {
+                close_files();
+                return false;
+            }
+            fprintf(video_file, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 Cmono\n",
+                    SCREEN_WIDTH, SCREEN_HEIGHT, FPS_NUM, FPS_DEN);
+            write_wav_header();
+        } else {
+            video_file = fopen((basename + ".gbrc").c_str(), "wb");
+            if (!video_file)
+                return false;
+            uint32_t header[4] = {RAW_VERSION, SCREEN_WIDTH, SCREEN_HEIGHT, (uint32_t)sample_rate};
+            fwrite(RAW_MAGIC, 1, 4, video_file);
+            fwrite(header, sizeof(header), 1, video_file);
+        }
+        frames_written = 0;
+        audio_bytes = 0;
+        return true;
+    }
+
+    void close_files() {
+        if (audio_file) {
+            write_wav_header();
+            fclose(audio_file);
+            audio_file = nullptr;
+        }
+        if (video_file) {
+            fclose(video_file);
+            video_file = nullptr;
+        }
+    }
+
+    void write_loop() {
+        StereoSample chunk[4096];
+
+        while (true) {
+            bool stopping = !running;
+            bool idle = true;
+
+            while (VideoFrame *frame = frames.front()) {
+                write_frame(*frame);
+                frames.pop();
+                idle = false;
+            }
+
+            size_t count;
+            while ((count = audio.pop(chunk, 4096)) > 0) {
+                write_audio(chunk, count);
+                idle = false;
+            }
+
+            if (stopping && idle)
+                break;
+            if (idle)
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    void write_frame(const VideoFrame &frame) {
+        if (format == REC_Y4M_WAV) {
+            static const uint8_t luma[4] = {235, 160, 86, 16};
+            uint8_t plane[FRAME_SIZE];
+            for (int i = 0; i < FRAME_SIZE; i++)
+                plane[i] = luma[frame.pixels[i] & 0x03];
+            fprintf(video_file, "FRAME Xnumber=%llu\n", (unsigned long long)frame.number);
+            fwrite(plane, 1, FRAME_SIZE, video_file);
+        } else if (keyframe_interval <= 0 ? frames_written == 0 : frames_written % keyframe_interval == 0) {
+            write_frame_record(RAW_KEYFRAME, frame.number, frame.pixels, FRAME_SIZE);
+        } else {
+            write_delta(frame.number, frame.pixels);
+        }
+
+        memcpy(previous, frame.pixels, FRAME_SIZE);
+        frames_written++;
+    }
+
+    // Delta payload: repeated [u16 skip][u16 length][length bytes] runs of
+    // bytes that differ from the previous frame.
+    void write_delta(uint64_t number, const uint8_t *pixels) {
+        uint8_t payload[FRAME_SIZE * 3];
+        uint32_t size = 0;
+        int i = 0;
+
+        while (i < FRAME_SIZE) {
+            int start = i;
+            while (i < FRAME_SIZE && pixels[i] == previous[i])
+                i++;
+            if (i == FRAME_SIZE)
+                break;
+
+            uint16_t skip = i - start;
+            int run = i;
+            while (i < FRAME_SIZE && pixels[i] != previous[i] && i - run < 0xFFFF)
+                i++;
+            uint16_t length = i - run;
+
+            memcpy(payload + size, &skip, 2);
+            memcpy(payload + size + 2, &length, 2);
+            memcpy(payload + size + 4, pixels + run, length);
+            size += 4 + length;
+        }
+
+        if (size >= FRAME_SIZE)
+            write_frame_record(RAW_KEYFRAME, number, pixels, FRAME_SIZE);
+        else
+            write_frame_record(RAW_DELTA, number, payload, size);
+    }
+
+    void write_audio(const StereoSample *samples, size_t count) {
+        uint32_t size = count * sizeof(StereoSample);
+        if (format == REC_Y4M_WAV) {
+            fwrite(samples, sizeof(StereoSample), count, audio_file);
+            audio_bytes += size;
+        } else {
+            write_record(RAW_AUDIO, samples, size);
+        }
+    }
+
+    void write_record(char type, const void *data, uint32_t size) {
+        fputc(type, video_file);
+        fwrite(&size, 4, 1, video_file);
+        fwrite(data, 1, size, video_file);
+    }
+
+    // Frame records start with the u64 frame number.
+    void write_frame_record(char type, uint64_t number, const void *data, uint32_t size) {
+        uint32_t record_size = 8 + size;
+        fputc(type, video_file);
+        fwrite(&record_size, 4, 1, video_file);
+        fwrite(&number, 8, 1, video_file);
+        fwrite(data, 1, size, video_file);
+    }
+
+    // 16-bit stereo PCM, rewritten with the final sizes on close
+    void write_wav_header() {
+        uint32_t byte_rate = sample_rate * sizeof(StereoSample);
+        uint32_t riff_size = 36 + audio_bytes;
+        uint32_t fmt_size = 16;
+        uint16_t pcm = 1, channels = 2, block_align = sizeof(StereoSample), bits = 16;
+        uint32_t rate = sample_rate;
+
+        fseek(audio_file, 0, SEEK_SET);
+        fwrite("RIFF", 1, 4, audio_file);
+        fwrite(&riff_size, 4, 1, audio_file);
+        fwrite("WAVEfmt ", 1, 8, audio_file);
+        fwrite(&fmt_size, 4, 1, audio_file);
+        fwrite(&pcm, 2, 1, audio_file);
+        fwrite(&channels, 2, 1, audio_file);
+        fwrite(&rate, 4, 1, audio_file);
+        fwrite(&byte_rate, 4, 1, audio_file);
+        fwrite(&block_align, 2, 1, audio_file);
+        fwrite(&bits, 2, 1, audio_file);
+        fwrite("data", 1, 4, audio_file);
+        fwrite(&audio_bytes, 4, 1, audio_file);
+        fseek(audio_file, 0, SEEK_END);
+    }
+};
@@ -0,0 +1,32 @@
+#include <iostream>
+#include <string>
+
+#include "rom_store.h"
+
+// rom_store serve <socket>           run the store
+// rom_store load <socket> <rom>...   load ROMs through a running store
+int main(int argc, char **argv) {
+    if (argc == 3 && std::string(argv[1]) == "serve") {
+        ROMStore store;
+        return store.serve(argv[2]) ? 0 : 1;
+    }
+
+    if (argc >= 4 && std::string(argv[1]) == "load") {
+        ROMStoreClient client;
+        if (!client.connect(argv[2]))
+            return 1;
+
+        for (int i = 3; i < argc; i++) {
+            ROMIdentity identity;
+            std::shared_ptr<const ROMImage> rom = client.load(argv[i], &identity);
+            if (!rom)
+                return 1;
+            std::cout << identity.key() << "  " << rom->size << "  " << argv[i] << "\n";
+        }
+        return 0;
+    }
+
+    std::cout << "Usage: rom_store serve <socket>\n"
+              << "       rom_store load <socket> <rom>...\n";
+    return 1;
+}
@@ -0,0 +1,327 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../cartridge/rom_identity.h"
+#include "../cartridge/rom_image.h"
+
+#define STORE_MESSAGE_SIZE  4096
+#define STORE_SEALS         (F_SEAL_SEAL | F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE)
+
+// Requests, one SOCK_SEQPACKET message each:
+//   LOAD <path>                    load (once) and return the ROM at path
+//   GET <crc32>-<xxh64> <size>     return a ROM that is already in the store
+// Replies are "OK <crc32>-<xxh64> <size>" with the memfd attached, or
+// "ERR <reason>".
+
+// Every ROM is held once, in a sealed memfd, keyed by its ROMIdentity so
+// all processes mapping it share the same pages. Used directly (library
+// mode) or served to other processes by serve().
+class ROMStore {
+public:
+    ROMStore() {}
+
+    ROMStore(const ROMStore &) = delete;
+    ROMStore &operator=(const ROMStore &) = delete;
+
+    ~ROMStore() {
+        for (auto &entry : roms)
+            ::close(entry.second.fd);
+    }
+
+    // Loads filename (plain or compressed) unless the same file was loaded
+    // before. Returns the memfd (owned by the store) or -1, and the ROM's
+    // identity. Reading, decompressing and sealing happen outside the lock,
+    // so clients loading different ROMs don't wait for each other.
+    int load(const char *filename, ROMIdentity &identity) {
+        struct stat st;
+        if (stat(filename, &st) < 0) {
+            std::cout << "Failed to open " << filename << "\n";
+            return -1;
+        }
+        FileKey key(st.st_dev, st.st_ino, st.st_size, (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto known = files.find(key);
+            if (known != files.end()) {
+                identity = known->second;
+                return roms.at(identity.xxh64).fd;
+            }
+        }
+
+        ROMImage image;
+        if (!image.open(filename))
+            return -1;
+        identity = identify_rom(image.data, image.size);
+
+        int sealed = -1;
+        if (find(identity) < 0 && (sealed = seal(image, identity)) < 0)
+            return -1;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto stored = roms.find(identity.xxh64);
+        if (stored == roms.end()) {
+            stored = roms.emplace(identity.xxh64, StoredROM{sealed, identity}).first;
+        } else {
+            // another client stored it in the meantime
+            if (sealed >= 0)
+                ::close(sealed);
+            if (!(stored->second.identity == identity)) {
+                std::cout << "XXH64 collision with a stored ROM: " << filename << "\n";
+                return -1;
+            }
+        }
+        // recorded only once the content is stored (possibly under another
+        // name), so a failed seal is retried on the next LOAD
+        files[key] = identity;
+        return stored->second.fd;
+    }
+
+    // memfd of a stored ROM, -1 if it isn't in the store. CRC32 and size
+    // have to match too, so an XXH64 collision can't serve another ROM.
+    int find(const ROMIdentity &identity) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = roms.find(identity.xxh64);
+        return it != roms.end() && it->second.identity == identity ? it->second.fd : -1;
+    }
+
+    // Accepts clients on a Unix socket until the process ends, one thread
+    // per connection.
+    bool serve(const char *socket_path) {
+        int server = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+        sockaddr_un address = store_address(socket_path);
+        unlink(socket_path);
+        if (server < 0 || bind(server, (sockaddr *)&address, sizeof(address)) < 0 || listen(server, 64) < 0) {
+            std::cout << "Failed to listen on " << socket_path << "\n";
+            if (server >= 0)
+                ::close(server);
+            return false;
+        }
+
+        while (true) {
+            int client = accept(server, nullptr, nullptr);
+            if (client < 0)
+                continue;
+            std::thread(&ROMStore::handle, this, client).detach();
+        }
+    }
+
+    // "<crc32>-<xxh64> <size>", as in requests and replies.
+    static bool parse_identity(const char *text, ROMIdentity &identity) {
+        unsigned crc32;
+        unsigned long long xxh64, size;
+        if (sscanf(text, "%8x-%16llx %llu", &crc32, &xxh64, &size) != 3)
+            return false;
+        identity.crc32 = crc32;
+        identity.xxh64 = xxh64;
+        identity.size = size;
+        return true;
+    }
+
+    static sockaddr_un store_address(const char *socket_path) {
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+        return address;
+    }
+
+private:
+    typedef std::tuple<dev_t, ino_t, off_t, int64_t> FileKey;
+
+    struct StoredROM {
+        int fd;
+        ROMIdentity identity;
+    };
+
+    std::mutex mutex;
+    std::map<uint64_t, StoredROM> roms;     // by XXH64
+    std::map<FileKey, ROMIdentity> files;
+
+    // Copies the image into a new memfd and seals it, so no process
+    // (including this one) can change or resize it afterwards.
+    static int seal(const ROMImage &image, const ROMIdentity &identity) {
+        std::string name = "rom-" + identity.key();
+        int fd = memfd_create(name.c_str(), MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (fd < 0)
+            return -1;
+
+        size_t written = 0;
+        while (written < image.size) {
+            ssize_t n = write(fd, image.data + written, image.size - written);
+            if (n <= 0) {
+                ::close(fd);
+                return -1;
+            }
+            written += n;
+        }
+
+        if (fcntl(fd, F_ADD_SEALS, STORE_SEALS) < 0) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    void handle(int client) {
+        char request[STORE_MESSAGE_SIZE];
+        ssize_t length;
+        while ((length = recv(client, request, sizeof(request) - 1, 0)) > 0) {
+            request[length] = '\0';
+
+            ROMIdentity identity;
+            int fd = -1;
+            if (strncmp(request, "LOAD ", 5) == 0)
+                fd = load(request + 5, identity);
+            else if (strncmp(request, "GET ", 4) == 0 && parse_identity(request + 4, identity))
+                fd = find(identity);
+
+            char reply[64];
+            if (fd < 0) {
+                snprintf(reply, sizeof(reply), "ERR not found");
+                send(client, reply, strlen(reply), MSG_NOSIGNAL);
+                continue;
+            }
+
+            snprintf(reply, sizeof(reply), "OK %s %llu", identity.key().c_str(), (unsigned long long)identity.size);
+            send_fd(client, reply, fd);
+        }
+        ::close(client);
+    }
+
+    static void send_fd(int client, const char *reply, int fd) {
+        iovec io = {const_cast<char *>(reply), strlen(reply)};
+        char control[CMSG_SPACE(sizeof(int))];
+        memset(control, 0, sizeof(control));
+
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &io;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        cmsghdr *header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(header), &fd, sizeof(int));
+
+        sendmsg(client, &message, MSG_NOSIGNAL);
+    }
+};
+
+// Client side of the store. Maps ROMs read-only straight from the store's
+// memfds; the pages are the same ones every other client maps.
+class ROMStoreClient {
+public:
+    ROMStoreClient() {}
+
+    ROMStoreClient(const ROMStoreClient &) = delete;
+    ROMStoreClient &operator=(const ROMStoreClient &) = delete;
+
+    ~ROMStoreClient() {
+        if (connection >= 0)
+            ::close(connection);
+    }
+
+    bool connect(const char *socket_path) {
+        connection = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        sockaddr_un address = ROMStore::store_address(socket_path);
+        if (connection < 0 || ::connect(connection, (sockaddr *)&address, sizeof(address)) < 0) {
+            std::cout << "Failed to connect to " << socket_path << "\n";
+            return false;
+        }
+        return true;
+    }
+
+    // The path is resolved here, the store may run in another directory.
+    std::shared_ptr<const ROMImage> load(const char *filename, ROMIdentity *identity = nullptr) {
+        char *path = realpath(filename, nullptr);
+        if (!path) {
+            std::cout << "Failed to open " << filename << "\n";
+            return nullptr;
+        }
+        std::shared_ptr<const ROMImage> image = request(std::string("LOAD ") + path, identity);
+        free(path);
+        return image;
+    }
+
+    std::shared_ptr<const ROMImage> get(const ROMIdentity &identity) {
+        char request_text[64];
+        snprintf(request_text, sizeof(request_text), "GET %s %llu", identity.key().c_str(), (unsigned long long)identity.size);
+        ROMIdentity stored;
+        std::shared_ptr<const ROMImage> image = request(request_text, &stored);
+        return image && stored == identity ? image : nullptr;
+    }
+
+private:
+    int connection = -1;
+
+    std::shared_ptr<const ROMImage> request(const std::string &text, ROMIdentity *identity) {
+        if (connection < 0 || send(connection, text.data(), text.size(), MSG_NOSIGNAL) < 0)
+            return nullptr;
+
+        char reply[64];
+        char control[CMSG_SPACE(sizeof(int))];
+        iovec io = {reply, sizeof(reply) - 1};
+        msghdr message;
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &io;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        ssize_t length = recvmsg(connection, &message, MSG_CMSG_CLOEXEC);
+        if (length <= 0)
+            return nullptr;
+        reply[length] = '\0';
+
+        int fd = -1;
+        cmsghdr *header = CMSG_FIRSTHDR(&message);
+        if (header && header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+            memcpy(&fd, CMSG_DATA(header), sizeof(int));
+
+        if (strncmp(reply, "OK ", 3) != 0 || fd < 0) {
+            std::cout << "ROM store: " << reply << "\n";
+            if (fd >= 0)
+                ::close(fd);
+            return nullptr;
+        }
+        ROMIdentity stored;
+        if (!ROMStore::parse_identity(reply + 3, stored)) {
+            std::cout << "ROM store: bad reply " << reply << "\n";
+            ::close(fd);
+            return nullptr;
+        }
+        if (identity)
+            *identity = stored;
+
+        // only ever map a memfd that can't change under us, and that holds
+        // as many bytes as the store says
+        std::shared_ptr<ROMImage> image = std::make_shared<ROMImage>();
+        int seals = fcntl(fd, F_GET_SEALS);
+        bool ok = seals >= 0 && (seals & STORE_SEALS) == STORE_SEALS && image->map(fd, text.c_str()) &&
+                  image->size == stored.size;
+        ::close(fd);
+        return ok ? image : nullptr;
+    }
+};
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../util/fnv1a.h"
+
+#define NEVER UINT64_MAX
+#define FRAME_CYCLES    17556   // M-cycles per video frame
+
+enum Event {
+    EVENT_FRAME,
+    EVENT_APU_FRAME,
+    EVENT_TIMER,
+    EVENT_DMA_END,
+    EVENT_SERIAL,
+    EVENT_SERIAL_SYNC,
+    EVENT_COUNT
+};
+
+// Event timeline in M-cycles. Components schedule the next time they need
+// attention instead of being ticked, the run loop only compares now with next.
+class Scheduler {
+public:
+    uint64_t now = 0;
+    uint64_t next = NEVER;
+    uint64_t when[EVENT_COUNT];
+    uint64_t due = 0;   // when the event pop_due returned was due
+
+    Scheduler() {
+        for (int i = 0; i < EVENT_COUNT; i++)
+            when[i] = NEVER;
+    }
+
+    void schedule(Event event, uint64_t at) {
+        when[event] = at;
+        if (at < next)
+            next = at;
+        else
+            update_next();
+    }
+
+    void cancel(Event event) {
+        when[event] = NEVER;
+        update_next();
+    }
+
+    bool pending(Event event) const {
+        return when[event] != NEVER;
+    }
+
+    // Removes and returns the earliest event that is due, or EVENT_COUNT.
+    Event pop_due() {
+        if (now < next)
+            return EVENT_COUNT;
+
+        int event = 0;
+        for (int i = 1; i < EVENT_COUNT; i++)
+            if (when[i] < when[event])
+                event = i;
+
+        due = when[event];
+        when[event] = NEVER;
+        update_next();
+        return static_cast<Event>(event);
+    }
+
+    uint64_t state_hash(uint64_t hash) const {
+        hash = fnv1a_value(now, hash);
+        return fnv1a(when, sizeof(when), hash);
+    }
+
+private:
+    void update_next() {
+        next = NEVER;
+        for (int i = 0; i < EVENT_COUNT; i++)
+            if (when[i] < next)
+                next = when[i];
+    }
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <thread>
+
+#include "../scheduler/scheduler.h"
+#include "../util/spsc_queue.h"
+
+// Serial registers
+#define SB      0xFF01
+#define SC      0xFF02
+
+#define SC_TRANSFER     0x80
+#define SC_INTERNAL     0x01
+
+#define SERIAL_TRANSFER_CYCLES  1024    // 8 bits at 8192 Hz, in M-cycles
+
+// One end of a link cable. The other instance may run on another thread,
+// so everything crossing the cable is either atomic or goes through the
+// peer's single producer inbox.
+struct LinkPort {
+    // SB in the low byte, bit 8 set while waiting for the peer's clock
+    std::atomic<uint16_t> published{0};
+    // M-cycle this end has reached, and the one the peer may run up to
+    // without missing a transfer from this end
+    std::atomic<uint64_t> clock{0};
+    std::atomic<uint64_t> horizon{SERIAL_TRANSFER_CYCLES};
+    SPSCQueue<uint8_t> inbox{16};
+    LinkPort *peer = nullptr;
+};
+
+// Connects two instances. The DMG link protocol is point to point, so
+// larger groups are run as pairs. Each instance plugs in with Memory::connect.
+class LinkCable {
+public:
+    LinkPort ends[2];
+
+    LinkCable() {
+        ends[0].peer = &ends[1];
+        ends[1].peer = &ends[0];
+    }
+};
+
+// Linked instances run in lockstep on emulated time, not wall clock time. A
+// transfer can't complete sooner than SERIAL_TRANSFER_CYCLES after it starts,
+// so each side may run that far past the other, or up to the end of the
+// other's transfer, and stops there (sync) until the other catches up. The
+// clocking side completes a transfer only once the peer has stopped at its
+// end, so the byte it sees and the time the peer takes the answer from its
+// inbox don't depend on how fast either thread runs.
+class Serial {
+public:
+    LinkPort *port = nullptr;
+
+    uint8_t read(uint16_t address) {
+        return address == SB ? sb : sc | 0x7E;
+    }
+
+    // Returns when the started transfer completes (M-cycles), or NEVER if
+    // this write didn't start one on the internal clock.
+    uint64_t write(uint16_t address, uint8_t value, uint64_t now) {
+        if (address == SB) {
+            sb = value;
+            publish();
+            return NEVER;
+        }
+
+        sc = value;
+        transfer_end = (sc & SC_TRANSFER) && (sc & SC_INTERNAL) ? now + SERIAL_TRANSFER_CYCLES : NEVER;
+        publish();
+        if (port)
+            port->horizon.store(horizon(now), std::memory_order_release);
+        return transfer_end;
+    }
+
+    // Our clock finished 8 bits: swap bytes with the peer if it is waiting,
+    // otherwise shift in 0xFF as with no cable. Returns true for the
+    // serial interrupt.
+    bool complete(uint64_t now) {
+        if (transfer_end == NEVER)
+            return false;
+        uint8_t received = 0xFF;
+
+        if (port) {
+            port->clock.store(now, std::memory_order_release);
+            // the peer can't pass our horizon, transfer_end, so it stops there
+            while (port->peer->clock.load(std::memory_order_acquire) < transfer_end)
+                std::this_thread::yield();
+
+            uint16_t peer = port->peer->published.load(std::memory_order_acquire);
+            if (peer & 0x100) {
+                if (port->peer->inbox.push(sb))
+                    received = peer & 0xFF;
+                else
+                    std::cout << "Link cable inbox full, transfer dropped\n";
+            }
+        }
+
+        sb = received;
+        sc &= ~SC_TRANSFER;
+        transfer_end = NEVER;
+        publish();
+        if (port) {
+            port->horizon.store(horizon(now), std::memory_order_release);
+            port->clock.store(now, std::memory_order_release);
+        }
+        return true;
+    }
+
+    // Scheduled at the peer's horizon: tells the peer how far we got, waits
+    // until it is far enough ahead, then takes the byte it clocked in, if
+    // any. Returns true for the serial interrupt.
+    bool sync(uint64_t now) {
+        publish_clock(now);
+        // our own transfer is due first: complete() does the waiting
+        while (port->peer->horizon.load(std::memory_order_acquire) <= now && transfer_end > now)
+            std::this_thread::yield();
+
+        uint8_t *received = port->inbox.front();
+        if (!received)
+            return false;
+
+        sb = *received;
+        port->inbox.pop();
+        sc &= ~SC_TRANSFER;
+        publish();
+        return true;
+    }
+
+    // Also whenever the instance stops running, or the peer could be left
+    // waiting short of the same point.
+    void publish_clock(uint64_t now) {
+        port->horizon.store(horizon(now), std::memory_order_release);
+        port->clock.store(now, std::memory_order_release);
+    }
+
+    // When sync has to run next.
+    uint64_t next_sync(uint64_t now) {
+        uint64_t at = port->peer->horizon.load(std::memory_order_acquire);
+        return at > now ? at : now;
+    }
+
+private:
+    uint8_t sb = 0;
+    uint8_t sc = 0;
+    uint64_t transfer_end = NEVER;
+
+    uint64_t horizon(uint64_t now) {
+        return transfer_end != NEVER ? transfer_end : now + SERIAL_TRANSFER_CYCLES;
+    }
+
+    void publish() {
+        if (!port)
+            return;
+        uint16_t armed = ((sc & SC_TRANSFER) && !(sc & SC_INTERNAL)) ? 0x100 : 0;
+        port->published.store(armed | sb, std::memory_order_release);
+    }
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstdint>
+
+#include "../scheduler/scheduler.h"
+#include "../util/fnv1a.h"
+
+// Timer registers
+#define DIV     0xFF04
+#define TIMA    0xFF05
+#define TMA     0xFF06
+#define TAC     0xFF07
+
+#define TAC_ENABLE  0x04
+
+// DIV and TIMA are never ticked. DIV is the upper byte of a 16-bit counter
+// that started at counter_base, TIMA is brought up to date from the number of
+// counter edges since it was last synced. All times here are T-cycles, the
+// interface takes M-cycles like the rest of the scheduler.
+//
+// Not modelled: the DIV/TAC write falling-edge glitches and the one M-cycle
+// window in which TIMA reads 0 before the TMA reload.
+class Timer {
+public:
+    uint8_t read(uint16_t address, uint64_t now) {
+        switch (address) {
+            case DIV:  return counter(now * 4) >> 8;
+            case TIMA: return tima;
+            case TMA:  return tma;
+            default:   return tac | 0xF8;
+        }
+    }
+
+    // sync() must have been called for now.
+    void write(uint16_t address, uint8_t value, uint64_t now) {
+        switch (address) {
+            case DIV:
+                counter_base = now * 4;
+                tima_time = counter_base;
+                break;
+            case TIMA:
+                tima = value;
+                break;
+            case TMA:
+                tma = value;
+                break;
+            case TAC:
+                tac = value & 0x07;
+                tima_time = now * 4;
+                break;
+        }
+    }
+
+    // Brings TIMA up to now. Returns true if it overflowed on the way.
+    bool sync(uint64_t now) {
+        uint64_t t = now * 4;
+        if (!(tac & TAC_ENABLE) || t <= tima_time) {
+            if (t > tima_time)
+                tima_time = t;
+            return false;
+        }
+
+        uint64_t ticks = edges(t) - edges(tima_time);
+        tima_time = t;
+
+        bool overflow = false;
+        while (ticks) {
+            uint64_t room = 256 - tima;
+            if (ticks < room) {
+                tima += ticks;
+                break;
+            }
+            ticks -= room;
+            tima = tma;
+            overflow = true;
+        }
+        return overflow;
+    }
+
+    // M-cycle at which TIMA will next overflow, for the scheduler.
+    uint64_t next_overflow() {
+        if (!(tac & TAC_ENABLE))
+            return NEVER;
+
+        uint64_t edge = edges(tima_time) + (256 - tima);
+        return (counter_base + edge * period()) / 4;
+    }
+
+    uint64_t state_hash(uint64_t hash) const {
+        hash = fnv1a_value(counter_base, hash);
+        hash = fnv1a_value(tima_time, hash);
+        hash = fnv1a_value(tima, hash);
+        hash = fnv1a_value(tma, hash);
+        return fnv1a_value(tac, hash);
+    }
+
+private:
+    uint64_t counter_base = 0;
+    uint64_t tima_time = 0;
+    uint8_t tima = 0;
+    uint8_t tma = 0;
+    uint8_t tac = 0;
+
+    uint16_t counter(uint64_t t) {
+        return t - counter_base;
+    }
+
+    // TIMA counts falling edges of counter bit 9, 3, 5 or 7
+    uint32_t period() {
+        static const uint32_t periods[4] = {1024, 16, 64, 256};
+        return periods[tac & 0x03];
+    }
+
+    uint64_t edges(uint64_t t) {
+        return (t - counter_base) / period();
+    }
+};
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define BYTE_SUM_AVX2
+#endif
+
+inline uint64_t byte_sum_scalar(const uint8_t *data, size_t size) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; i++)
+        sum += data[i];
+    return sum;
+}
+
+#ifdef BYTE_SUM_AVX2
+// vpsadbw against zero adds each group of 8 bytes into a 64-bit lane, so
+// there is nothing to widen and no lane can overflow. Four accumulators keep
+// the loads ahead of the adds.
+__attribute__((target("avx2")))
+inline uint64_t byte_sum_avx2(const uint8_t *data, size_t size) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sum0 = zero, sum1 = zero, sum2 = zero, sum3 = zero;
+    size_t i = 0;
+
+    for (; i + 128 <= size; i += 128) {
+        const __m256i *p = reinterpret_cast<const __m256i *>(data + i);
+        sum0 = _mm256_add_epi64(sum0, _mm256_sad_epu8(_mm256_loadu_si256(p), zero));
+        sum1 = _mm256_add_epi64(sum1, _mm256_sad_epu8(_mm256_loadu_si256(p + 1), zero));
+        sum2 = _mm256_add_epi64(sum2, _mm256_sad_epu8(_mm256_loadu_si256(p + 2), zero));
+        sum3 = _mm256_add_epi64(sum3, _mm256_sad_epu8(_mm256_loadu_si256(p + 3), zero));
+    }
+    for (; i + 32 <= size; i += 32) {
+        const __m256i *p = reinterpret_cast<const __m256i *>(data + i);
+        sum0 = _mm256_add_epi64(sum0, _mm256_sad_epu8(_mm256_loadu_si256(p), zero));
+    }
+
+    __m256i sum = _mm256_add_epi64(_mm256_add_epi64(sum0, sum1), _mm256_add_epi64(sum2, sum3));
+    __m128i half = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    uint64_t total = _mm_cvtsi128_si64(half) + _mm_extract_epi64(half, 1);
+
+    return total + byte_sum_scalar(data + i, size - i);
+}
+#endif
+
+// Sum of all bytes, using AVX2 when the CPU has it.
+inline uint64_t byte_sum(const uint8_t *data, size_t size) {
+#ifdef BYTE_SUM_AVX2
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2)
+        return byte_sum_avx2(data, size);
+#endif
+    return byte_sum_scalar(data, size);
+}
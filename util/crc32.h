@@ -0,0 +1,110 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CRC32_CLMUL
+#endif
+
+// CRC-32 (IEEE, reflected 0xEDB88320) as used by gzip, zip and ROM sets.
+constexpr std::array<uint32_t, 256> crc32_table() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xEDB88320 : crc >> 1;
+        table[i] = crc;
+    }
+    return table;
+}
+
+inline constexpr auto crc32_lookup = crc32_table();
+
+// On the inverted register, like the kernel below.
+inline uint32_t crc32_bytes(uint32_t crc, const uint8_t *data, size_t size) {
+    for (size_t i = 0; i < size; i++)
+        crc = crc32_lookup[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return crc;
+}
+
+#ifdef CRC32_CLMUL
+// Carry-less multiply folding (Intel, "Fast CRC Computation for Generic
+// Polynomials Using PCLMULQDQ"): four 128-bit lanes are folded forward 64
+// bytes at a time, then into one lane, then Barrett reduced to 32 bits.
+// size must be a multiple of 16 and at least 64.
+__attribute__((target("pclmul,sse4.1")))
+inline uint32_t crc32_clmul(uint32_t crc, const uint8_t *data, size_t size) {
+    alignas(16) static const uint64_t k1k2[2] = {0x0154442BD4, 0x01C6E41596};
+    alignas(16) static const uint64_t k3k4[2] = {0x01751997D0, 0x00CCAA009E};
+    alignas(16) static const uint64_t k5k0[2] = {0x0163CD6124, 0x0000000000};
+    alignas(16) static const uint64_t poly[2] = {0x01DB710641, 0x01F7011641};
+
+    const __m128i *p = reinterpret_cast<const __m128i *>(data);
+    __m128i x1 = _mm_xor_si128(_mm_loadu_si128(p), _mm_cvtsi32_si128(crc));
+    __m128i x2 = _mm_loadu_si128(p + 1);
+    __m128i x3 = _mm_loadu_si128(p + 2);
+    __m128i x4 = _mm_loadu_si128(p + 3);
+    __m128i k = _mm_load_si128(reinterpret_cast<const __m128i *>(k1k2));
+    p += 4;
+    size -= 64;
+
+    while (size >= 64) {
+        __m128i x5 = _mm_clmulepi64_si128(x1, k, 0x00);
+        __m128i x6 = _mm_clmulepi64_si128(x2, k, 0x00);
+        __m128i x7 = _mm_clmulepi64_si128(x3, k, 0x00);
+        __m128i x8 = _mm_clmulepi64_si128(x4, k, 0x00);
+        x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k, 0x11), x5), _mm_loadu_si128(p));
+        x2 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x2, k, 0x11), x6), _mm_loadu_si128(p + 1));
+        x3 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x3, k, 0x11), x7), _mm_loadu_si128(p + 2));
+        x4 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x4, k, 0x11), x8), _mm_loadu_si128(p + 3));
+        p += 4;
+        size -= 64;
+    }
+
+    // four lanes into one
+    k = _mm_load_si128(reinterpret_cast<const __m128i *>(k3k4));
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k, 0x11), _mm_clmulepi64_si128(x1, k, 0x00)), x2);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k, 0x11), _mm_clmulepi64_si128(x1, k, 0x00)), x3);
+    x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k, 0x11), _mm_clmulepi64_si128(x1, k, 0x00)), x4);
+
+    while (size >= 16) {
+        x1 = _mm_xor_si128(_mm_xor_si128(_mm_clmulepi64_si128(x1, k, 0x11), _mm_clmulepi64_si128(x1, k, 0x00)),
+                           _mm_loadu_si128(p));
+        p++;
+        size -= 16;
+    }
+
+    // 128 -> 64 bits
+    __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+    x2 = _mm_clmulepi64_si128(x1, k, 0x10);
+    x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+    k = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(k5k0));
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_xor_si128(_mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x00), x2);
+
+    // Barrett reduction to 32 bits
+    k = _mm_load_si128(reinterpret_cast<const __m128i *>(poly));
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x10);
+    x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask), k, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+    return _mm_extract_epi32(x1, 1);
+}
+#endif
+
+// Continues crc over data; start with crc = 0.
+inline uint32_t crc32(uint32_t crc, const uint8_t *data, size_t size) {
+    crc = ~crc;
+#ifdef CRC32_CLMUL
+    static const bool clmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+    if (clmul && size >= 64) {
+        size_t bulk = size & ~(size_t)15;
+        crc = crc32_clmul(crc, data, bulk);
+        data += bulk;
+        size -= bulk;
+    }
+#endif
+    return ~crc32_bytes(crc, data, size);
+}
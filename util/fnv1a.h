@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 64-bit FNV-1a, for ROM identity in movie headers and state comparison.
+inline uint64_t fnv1a(const void *data, size_t size, uint64_t hash = 0xCBF29CE484222325ULL) {
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// One field at a time, so struct padding never ends up in a hash.
+template <typename T>
+inline uint64_t fnv1a_value(const T &value, uint64_t hash) {
+    return fnv1a(&value, sizeof(value), hash);
+}
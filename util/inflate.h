@@ -0,0 +1,363 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+
+// Raw DEFLATE (RFC 1951) decoder. Input is pulled through source as it is
+// needed, output goes straight into the caller's buffer and is never copied:
+// back references read the bytes already written, so no separate window is
+// kept. When the buffer is full grow is asked for a bigger one.
+#define INFLATE_INPUT_SIZE  0x10000
+#define INFLATE_FAST_BITS   10
+#define INFLATE_MAX_BITS    15
+
+class Inflater {
+public:
+    // Fills buf with up to size bytes, 0 at end of input.
+    std::function<size_t(uint8_t *buf, size_t size)> source;
+    // Returns a buffer of at least size + 1 bytes whose first size bytes are
+    // the output so far, and sets capacity. nullptr aborts.
+    std::function<uint8_t *(size_t size, size_t &capacity)> grow;
+
+    uint8_t *out = nullptr;
+    size_t written = 0;
+    size_t capacity = 0;
+
+    Inflater() {
+        input = new uint8_t[INFLATE_INPUT_SIZE];
+    }
+
+    ~Inflater() {
+        delete[] input;
+    }
+
+    Inflater(const Inflater &) = delete;
+    Inflater &operator=(const Inflater &) = delete;
+
+    // Decodes one complete DEFLATE stream. False on corrupt or truncated data.
+    bool inflate() {
+        bool last;
+        do {
+            if (!need(3))
+                return false;
+            last = bits(1);
+            int type = bits(2);
+
+            bool ok;
+            switch (type) {
+                case 0:  ok = stored(); break;
+                case 1:  ok = fixed(); break;
+                case 2:  ok = dynamic(); break;
+                default: ok = false; break;
+            }
+            if (!ok)
+                return false;
+        } while (!last);
+        return true;
+    }
+
+    // Byte aligned reads for container headers and trailers around the stream.
+    bool read(uint8_t *buf, size_t size) {
+        align();
+        for (size_t i = 0; i < size; i++) {
+            if (!need(8))
+                return false;
+            buf[i] = bits(8);
+        }
+        return true;
+    }
+
+    bool skip(size_t size) {
+        uint8_t scratch[256];
+        while (size > 0) {
+            size_t chunk = size < sizeof(scratch) ? size : sizeof(scratch);
+            if (!read(scratch, chunk))
+                return false;
+            size -= chunk;
+        }
+        return true;
+    }
+
+private:
+    struct Huffman {
+        uint16_t fast[1 << INFLATE_FAST_BITS];  // (symbol << 4) | length, 0 for longer codes
+        uint16_t counts[INFLATE_MAX_BITS + 1];
+        uint16_t symbols[288];
+    };
+
+    uint8_t *input;
+    size_t input_pos = 0;
+    size_t input_end = 0;
+    uint64_t bitbuf = 0;
+    int bitcount = 0;
+
+    Huffman lengths, distances;
+
+    // Tops the bit buffer up; fewer than n bits only at end of input.
+    bool need(int n) {
+        while (bitcount < n) {
+            if (input_pos == input_end) {
+                input_end = source ? source(input, INFLATE_INPUT_SIZE) : 0;
+                input_pos = 0;
+                if (input_end == 0)
+                    return false;
+            }
+            bitbuf |= (uint64_t)input[input_pos++] << bitcount;
+            bitcount += 8;
+        }
+        return true;
+    }
+
+    // Like need(), but never fails, so short codes at the very end of the
+    // input still decode.
+    void fill() {
+        while (bitcount <= 56) {
+            if (input_pos == input_end) {
+                input_end = source ? source(input, INFLATE_INPUT_SIZE) : 0;
+                input_pos = 0;
+                if (input_end == 0)
+                    return;
+            }
+            bitbuf |= (uint64_t)input[input_pos++] << bitcount;
+            bitcount += 8;
+        }
+    }
+
+    uint32_t bits(int n) {
+        uint32_t value = bitbuf & ((1ull << n) - 1);
+        bitbuf >>= n;
+        bitcount -= n;
+        return value;
+    }
+
+    void align() {
+        bits(bitcount & 7);
+    }
+
+    bool reserve(size_t n) {
+        while (capacity - written < n) {
+            if (!grow || !(out = grow(written, capacity)))
+                return false;
+        }
+        return true;
+    }
+
+    // Canonical code from code lengths, plus a lookup table for every code
+    // of up to INFLATE_FAST_BITS bits.
+    static bool build(Huffman &h, const uint8_t *length, int n) {
+        memset(h.counts, 0, sizeof(h.counts));
+        memset(h.fast, 0, sizeof(h.fast));
+        for (int i = 0; i < n; i++)
+            h.counts[length[i]]++;
+        h.counts[0] = 0;
+
+        int left = 1;
+        for (int len = 1; len <= INFLATE_MAX_BITS; len++) {
+            left = (left << 1) - h.counts[len];
+            if (left < 0)
+                return false;   // over-subscribed
+        }
+
+        uint16_t offsets[INFLATE_MAX_BITS + 2];
+        offsets[1] = 0;
+        for (int len = 1; len <= INFLATE_MAX_BITS; len++)
+            offsets[len + 1] = offsets[len] + h.counts[len];
+        for (int i = 0; i < n; i++)
+            if (length[i])
+                h.symbols[offsets[length[i]]++] = i;
+
+        int code = 0, index = 0;
+        for (int len = 1; len <= INFLATE_FAST_BITS; len++) {
+            for (int i = 0; i < h.counts[len]; i++, code++, index++) {
+                int reversed = 0;
+                for (int bit = 0; bit < len; bit++)
+                    reversed |= ((code >> bit) & 1) << (len - 1 - bit);
+                for (int fill = reversed; fill < (1 << INFLATE_FAST_BITS); fill += 1 << len)
+                    h.fast[fill] = (h.symbols[index] << 4) | len;
+            }
+            code <<= 1;
+        }
+        return true;
+    }
+
+    int decode(const Huffman &h) {
+        fill();
+        uint16_t entry = h.fast[bitbuf & ((1 << INFLATE_FAST_BITS) - 1)];
+        if (entry) {
+            int len = entry & 0x0F;
+            if (len > bitcount)
+                return -1;
+            bits(len);
+            return entry >> 4;
+        }
+
+        // longer codes, one bit at a time
+        int code = 0, first = 0, index = 0;
+        for (int len = 1; len <= INFLATE_MAX_BITS && len <= bitcount; len++) {
+            code |= (bitbuf >> (len - 1)) & 1;
+            int count = h.counts[len];
+            if (code - count < first) {
+                bits(len);
+                return h.symbols[index + code - first];
+            }
+            index += count;
+            first = (first + count) << 1;
+            code <<= 1;
+        }
+        return -1;
+    }
+
+    bool stored() {
+        uint8_t header[4];
+        if (!read(header, 4))
+            return false;
+        uint16_t length = header[0] | (header[1] << 8);
+        uint16_t complement = header[2] | (header[3] << 8);
+        if (length != (uint16_t)~complement || !reserve(length))
+            return false;
+
+        // whatever is left in the bit buffer first, then straight from input
+        while (length > 0 && bitcount >= 8) {
+            out[written++] = bits(8);
+            length--;
+        }
+        while (length > 0) {
+            if (input_pos == input_end) {
+                input_end = source ? source(input, INFLATE_INPUT_SIZE) : 0;
+                input_pos = 0;
+                if (input_end == 0)
+                    return false;
+            }
+            size_t chunk = input_end - input_pos < length ? input_end - input_pos : length;
+            memcpy(out + written, input + input_pos, chunk);
+            input_pos += chunk;
+            written += chunk;
+            length -= chunk;
+        }
+        return true;
+    }
+
+    bool fixed() {
+        uint8_t length[288];
+        int i = 0;
+        for (; i < 144; i++) length[i] = 8;
+        for (; i < 256; i++) length[i] = 9;
+        for (; i < 280; i++) length[i] = 7;
+        for (; i < 288; i++) length[i] = 8;
+        build(lengths, length, 288);
+        for (i = 0; i < 30; i++) length[i] = 5;
+        build(distances, length, 30);
+        return codes();
+    }
+
+    bool dynamic() {
+        static const uint8_t order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+
+        if (!need(14))
+            return false;
+        int nlen = bits(5) + 257;
+        int ndist = bits(5) + 1;
+        int ncode = bits(4) + 4;
+        if (nlen > 286 || ndist > 30)
+            return false;
+
+        uint8_t length[320] = {0};
+        for (int i = 0; i < ncode; i++) {
+            if (!need(3))
+                return false;
+            length[order[i]] = bits(3);
+        }
+        if (!build(lengths, length, 19))
+            return false;
+
+        memset(length, 0, sizeof(length));
+        int index = 0;
+        while (index < nlen + ndist) {
+            int symbol = decode(lengths);
+            if (symbol < 0)
+                return false;
+            if (symbol < 16) {
+                length[index++] = symbol;
+                continue;
+            }
+
+            uint8_t repeat = 0;
+            int count;
+            if (symbol == 16) {
+                if (index == 0 || !need(2))
+                    return false;
+                repeat = length[index - 1];
+                count = 3 + bits(2);
+            } else if (symbol == 17) {
+                if (!need(3))
+                    return false;
+                count = 3 + bits(3);
+            } else {
+                if (!need(7))
+                    return false;
+                count = 11 + bits(7);
+            }
+            if (index + count > nlen + ndist)
+                return false;
+            while (count--)
+                length[index++] = repeat;
+        }
+
+        if (length[256] == 0)
+            return false;   // no end of block code
+        if (!build(lengths, length, nlen) || !build(distances, length + nlen, ndist))
+            return false;
+        return codes();
+    }
+
+    bool codes() {
+        static const uint16_t length_base[29] = {
+            3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+            35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        static const uint8_t length_extra[29] = {
+            0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+            3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+        static const uint16_t distance_base[30] = {
+            1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+            257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+        static const uint8_t distance_extra[30] = {
+            0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+            7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+        while (true) {
+            int symbol = decode(lengths);
+            if (symbol < 0)
+                return false;
+
+            if (symbol < 256) {
+                if (!reserve(1))
+                    return false;
+                out[written++] = symbol;
+                continue;
+            }
+            if (symbol == 256)
+                return true;
+
+            symbol -= 257;
+            if (symbol >= 29 || !need(length_extra[symbol]))
+                return false;
+            size_t length = length_base[symbol] + bits(length_extra[symbol]);
+
+            symbol = decode(distances);
+            if (symbol < 0 || symbol >= 30 || !need(distance_extra[symbol]))
+                return false;
+            size_t distance = distance_base[symbol] + bits(distance_extra[symbol]);
+            if (distance > written || !reserve(length))
+                return false;
+
+            // byte by byte, the source may overlap what is being written
+            uint8_t *to = out + written;
+            const uint8_t *from = to - distance;
+            for (size_t i = 0; i < length; i++)
+                to[i] = from[i];
+            written += length;
+        }
+    }
+};
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Lock-free single producer / single consumer ring buffer. Capacity is
+// rounded up to a power of two; one side may only ever be used by one thread.
+template <typename T>
+class SPSCQueue {
+public:
+    SPSCQueue(size_t _capacity) {
+        capacity = 1;
+        while (capacity < _capacity)
+            capacity <<= 1;
+        mask = capacity - 1;
+        buffer = new T[capacity];
+    }
+
+    ~SPSCQueue() {
+        delete[] buffer;
+    }
+
+    SPSCQueue(const SPSCQueue &) = delete;
+    SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+    // Producer side. Returns a slot to fill in place, or nullptr when full.
+    // The slot only becomes visible to the consumer after commit().
+    T *reserve() {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == capacity)
+            return nullptr;
+        return &buffer[t & mask];
+    }
+
+    void commit() {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool push(const T &item) {
+        T *slot = reserve();
+        if (!slot)
+            return false;
+        *slot = item;
+        commit();
+        return true;
+    }
+
+    // Pushes as many of items as fit, returns how many were queued.
+    size_t push(const T *items, size_t count) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        size_t free = capacity - (t - head.load(std::memory_order_acquire));
+        if (count > free)
+            count = free;
+        for (size_t i = 0; i < count; i++)
+            buffer[(t + i) & mask] = items[i];
+        tail.store(t + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer side. Returns the oldest item without removing it, or nullptr.
+    T *front() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire))
+            return nullptr;
+        return &buffer[h & mask];
+    }
+
+    void pop() {
+        head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    size_t pop(T *items, size_t count) {
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t used = tail.load(std::memory_order_acquire) - h;
+        if (count > used)
+            count = used;
+        for (size_t i = 0; i < count; i++)
+            items[i] = buffer[(h + i) & mask];
+        head.store(h + count, std::memory_order_release);
+        return count;
+    }
+
+    size_t size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+private:
+    T *buffer;
+    size_t capacity;
+    size_t mask;
+
+    // head and tail on separate cache lines so producer and consumer don't
+    // bounce the same line between cores
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};